@@ -1,10 +1,182 @@
 
 #include <sys/time.h>
 #include <cstdlib>
+#include <math.h>
+#include <algorithm>
+#include <iterator>
 
 #include "umission.h"
 #include "utime.h"
 #include "ulibpose2pose.h"
+#include "umissionio.h"
+#include "utiming.h"
+#include "uperfcount.h"
+#include "usnippettrace.h"
+#include "usnippetlink.h"
+#include "usnippetopt.h"
+#include "usnippetcode.h"
+#include "umissionbundle.h"
+#include "umetrics.h"
+#include "utracer.h"
+#include "ulinelook.h"
+#include "ustatemachine.h"
+
+
+/// bridge and camera access for the mission (can record and replay)
+static UMissionIO io;
+
+/// hardware counters for snippet formatting and upload
+static UPerfCount snippetPerf("snippet");
+
+/// round trip latency of snippets
+static USnippetTrace snippetTrace;
+
+/// snippet upload to the REGBOT threads
+static USnippetLink snippetLink(io);
+
+/// removes stops and merges lines before upload, if enabled
+static USnippetOptimiser snippetOpt;
+
+/// runtime metrics for the mission loop and snippets
+static UCounter * loopMetric = UMetrics::counter("mission.loops");
+static UGauge * partMetric = UMetrics::gauge("mission.part");
+static UGauge * stateMetric = UMetrics::gauge("mission.state");
+static UCounter * snippetMetric = UMetrics::counter("snippet.sent");
+static UCounter * snippetLineMetric = UMetrics::counter("snippet.lines");
+
+/// state machine for mission 1, time from io (so also in replay)
+static UStateMachine machine1("mission1", []() { return io.now(); });
+
+/// mission segments from file (MISSION_BUNDLE), reloaded when changed
+static UMissionBundle bundle;
+
+/// load static mission segments into REGBOT threads (missionInit)
+static void preloadSegments();
+
+/// camera look-ahead for the fast edge following legs
+static ULineLook lineLook;
+
+/**
+ * An edge following leg with velocity from the camera look-ahead.
+ * The leg starts with a default velocity, and is replaced by a new snippet
+ * (new velocity and remaining distance) when the look-ahead velocity
+ * differs enough. The rest of the segment after the leg is kept,
+ * so it can be sent again after the replaced leg. */
+struct ULookLeg
+{
+  static constexpr int MLL = 100;
+  static constexpr int MTL = 30;
+  bool active = false;
+  /// leg is driving (start event received)
+  bool started = false;
+  /// odometer distance at leg start [m]
+  float startDist = 0;
+  /// leg length [m]
+  float legDist = 0;
+  /// velocity in current snippet, and limits [m/s]
+  float vel = 0;
+  float vMin = 0.4;
+  float vMax = 1.2;
+  /// assignments except vel, and conditions except dist
+  char head[MLL];
+  char cond[MLL];
+  /// rest of segment after the leg
+  char tail[MTL][MLL];
+  int tailCnt = 0;
+  /// mission time (io.now()) of last replacement [sec]
+  double lastUpdate = 0;
+};
+
+static ULookLeg lookLeg;
+
+/**
+ * Set up a look-ahead leg, before the snippet with the leg is sent.
+ * \param legLine is the leg line in the snippet, e.g.
+ *        "event=25, vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1, xl>15",
+ *        the replacements keep all but the event, vel and dist
+ * \param tailLines are the lines after the leg line in the snippet
+ * \returns false if the leg line has no vel and dist */
+static bool lookLegSetup(ULookLeg & leg, const char * legLine,
+                         char ** tailLines, int tailCnt)
+{
+  const int MI = USnippetCode::MAX_ITEMS;
+  USnippetCode::UItem items[MI], head[MI], cond[MI];
+  int assignCnt, condCnt;
+  int headCnt = 0, condOther = 0;
+  bool hasVel = false, hasDist = false;
+  if (not USnippetCode::parse(legLine, items, MI, assignCnt, condCnt))
+  {
+    printf("# lookLegSetup: can not parse leg line '%s'\n", legLine);
+    return false;
+  }
+  for (int i = 0; i < assignCnt + condCnt; i++)
+  {
+    USnippetCode::UItem & it = items[i];
+    if (i < assignCnt and it.key == USnippetCode::key("vel"))
+    {
+      leg.vel = it.value;
+      hasVel = true;
+    }
+    else if (i >= assignCnt and it.key == USnippetCode::key("dist"))
+    {
+      leg.legDist = it.value;
+      hasDist = true;
+    }
+    else if (i < assignCnt and it.key != USnippetCode::key("event"))
+      head[headCnt++] = it;
+    else if (i >= assignCnt)
+      cond[condOther++] = it;
+  }
+  if (not hasVel or not hasDist)
+  {
+    printf("# lookLegSetup: leg line '%s' has no vel or no dist\n", legLine);
+    return false;
+  }
+  // as a list (with ',' only)
+  USnippetCode::format(head, headCnt, 0, leg.head, leg.MLL);
+  USnippetCode::format(cond, condOther, 0, leg.cond, leg.MLL);
+  leg.active = true;
+  leg.started = false;
+  leg.tailCnt = std::min(tailCnt, leg.MTL);
+  for (int i = 0; i < leg.tailCnt; i++)
+    snprintf(leg.tail[i], leg.MLL, "%s", tailLines[i]);
+  return true;
+}
+
+/**
+ * Test if the leg should be replaced with a new velocity
+ * \param dist is the current odometer distance
+ * \returns true if a new snippet should be sent (use lookLegFormat) */
+static bool lookLegUpdate(ULookLeg & leg, float dist)
+{
+  if (not leg.active or not leg.started)
+    return false;
+  float remaining = leg.legDist - (dist - leg.startDist);
+  double dt = io.now() - leg.lastUpdate;
+  if (remaining < 0.2 or dt < 0.25 or not lineLook.isValid())
+    return false;
+  float v = lineLook.getVelocity(leg.vMin, leg.vMax);
+  return fabsf(v - leg.vel) >= 0.15;
+}
+
+/**
+ * Format leg with new velocity and remaining distance, followed by
+ * the rest of the segment.
+ * \returns number of lines */
+static int lookLegFormat(ULookLeg & leg, char ** lines, int maxLen, float dist)
+{
+  int line = 0;
+  leg.vel = lineLook.getVelocity(leg.vMin, leg.vMax);
+  leg.legDist -= dist - leg.startDist;
+  leg.startDist = dist;
+  leg.lastUpdate = io.now();
+  snprintf(lines[line++], maxLen, "vel=%.2f%s%s: dist=%.2f%s%s",
+           leg.vel, leg.head[0] != '\0' ? ", " : "", leg.head,
+           leg.legDist, leg.cond[0] != '\0' ? ", " : "", leg.cond);
+  for (int i = 0; i < leg.tailCnt; i++)
+    snprintf(lines[line++], maxLen, "%s", leg.tail[i]);
+  return line;
+}
 
 
 
@@ -12,6 +184,16 @@ UMission::UMission(UBridge * regbot, UCamera * camera)
 {
   cam = camera;
   bridge = regbot;
+  // all mission I/O through io, so it can be recorded or replayed
+  io.setup(regbot, camera);
+  // completion events for snippet tracing
+  io.setEventHook([](int n, bool isSet) { snippetTrace.event(n, isSet, io.now()); });
+  // live metrics in a file and on 127.0.0.1:24010
+  UMetrics::start("mission_metrics.txt", 24010);
+  // segments from a mission file replace the built-in ones
+  const char * bundleFile = getenv("MISSION_BUNDLE");
+  if (bundleFile != NULL)
+    bundle.load(bundleFile);
   threadActive = 100;
   // initialize line list to empty
   for (int i = 0; i < missionLineMax; i++)
@@ -29,6 +211,11 @@ UMission::UMission(UBridge * regbot, UCamera * camera)
 
 UMission::~UMission()
 {
+  UMetrics::stop();
+  UTracer::stop();
+  lineLook.stop();
+  bundle.stop();
+  io.close();
   printf("Mission class destructor\n");
 }
 
@@ -48,13 +235,23 @@ void UMission::printStatus()
   printf("# ------- Mission ----------\n");
   printf("# active = %d, finished = %d\n", active, finished);
   printf("# mission part=%d, in state=%d\n", mission, missionState);
+  if (lookLeg.active)
+    lineLook.printStatus();
+  machine1.printStatus();
+  if (snippetOpt.enabled)
+    printf("# snippet optimiser: %d lines removed, predicted %.1f sec saved\n",
+           snippetOpt.linesRemoved, snippetOpt.totalSaved);
+  UTiming::printStatus();
+  UPerfCount::printAll();
+  snippetTrace.printStatus();
 }
   
 void UMission::missionInit()
 { // stop any not-finished mission
-  bridge->send("robot stop\n");
+  io.send("robot stop\n");
   // clear old mission
-  bridge->send("robot <clear\n");
+  io.send("robot <clear\n");
+  snippetLink.clear();
   //
   // add new mission with 3 threads
   // one (100) starting at event 30 and stopping at event 31
@@ -62,48 +259,43 @@ void UMission::missionInit()
   // one (  1) used for idle and initialisation of hardware
   // the mission is started, but staying in place (velocity=0, so servo action)
   //
-  bridge->send("robot <add thread=1\n");
+  io.send("robot <add thread=1\n");
   // Irsensor should be activated a good time before use 
   // otherwise first samples will produce "false" positive (too short/negative).
-  bridge->send("robot <add irsensor=1,vel=0:dist<0.2\n");
+  io.send("robot <add irsensor=1,vel=0:dist<0.2\n");
   //
   // alternating threads (100 and 101, alternating on event 30 and 31 (last 2 events)
-  bridge->send("robot <add thread=100,event=30 : event=31\n");
+  io.send("robot <add thread=100,event=30 : event=31\n");
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
     //  are to be replaced with real mission
     // NB - hereafter no lines can be added to these threads, just modified
-    bridge->send("robot <add vel=0 : time=0.1\n");
+    io.send("robot <add vel=0 : time=0.1\n");
   //
-  bridge->send("robot <add thread=101,event=31 : event=30\n");
+  io.send("robot <add thread=101,event=31 : event=30\n");
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
-    bridge->send("robot <add vel=0 : time=0.1\n");
-  usleep(10000);
+    io.send("robot <add vel=0 : time=0.1\n");
+  //
+  // static mission segments in their own threads (110, 111, ...),
+  // started by one event each (11, 12, ...)
+  preloadSegments();
+  io.sleep(10000);
   //
   //
   // send subscribe to bridge
-  bridge->pose->subscribe();
-  bridge->edge->subscribe();
-  bridge->motor->subscribe();
-  bridge->event->subscribe();
-  bridge->joy->subscribe();
-  bridge->motor->subscribe();
-  bridge->info->subscribe();
-  bridge->irdist->subscribe();
-  bridge->imu->subscribe();
-  usleep(10000);
+  io.subscribe();
+  io.sleep(10000);
   // there maybe leftover events from last mission
-  bridge->event->clearEvents();
+  io.clearEvents();
 }
 
 
 void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
 {
+  UPerfScope perf(snippetPerf);
   // Calling sendAndActivateSnippet automatically toggles between thread 100 and 101. 
   // Modifies the currently inactive thread and then makes it active. 
-  const int MSL = 100;
-  char s[MSL];
   int threadToMod = 101;
   int startEvent = 31;
   // select Regbot thread to modify
@@ -122,23 +314,22 @@ void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
     printf("# -----------------------------------------------\n");
     missionLineCnt = missionLineMax;
   }
-  // send mission lines using '<mod ...' command
-  for (int i = 0; i < missionLineCnt; i++)
-  { // send lines one at a time
-    if (strlen((char*)missionLines[i]) > 0)
-    { // send a modify line command
-      snprintf(s, MSL, "<mod %d %d %s\n", threadToMod, i+1, missionLines[i]);
-      bridge->send(s); 
-    }
-    else
-      // an empty line will end code snippet too
-      break;
-  }
-  // let it sink in (10ms)
-  usleep(10000);
+  // optional peephole optimising (MISSION_SNIPPET_OPT)
+  float saved;
+  missionLineCnt = snippetOpt.optimise(missionLines, missionLineCnt, MAX_LEN, saved);
+  if (saved > 0)
+    printf("# snippet optimised, predicted %.2f sec saved\n", saved);
+  snippetTrace.begin(mission, missionState, missionLines, missionLineCnt, io.now());
+  // send mission lines using '<mod ...' commands, all in one message
+  int n = snippetLink.upload(threadToMod, missionLines, missionLineCnt);
+  snippetLineMetric->add(n);
+  snippetTrace.sent(io.now());
+  snippetMetric->add();
+  // wait until the REGBOT has all lines (acknowledge event)
+  snippetLink.waitAck();
   // Activate new snippet thread and stop the other  
-  snprintf(s, MSL, "<event=%d\n", startEvent);
-  bridge->send(s);
+  snippetLink.activate(startEvent);
+  snippetTrace.activated(io.now());
   // save active thread number
   threadActive = threadToMod;
 }
@@ -162,25 +353,26 @@ void UMission::runMission()
   // fixed string buffer
   const int MSL = 120;
   char s[MSL];
+  UTracer::threadName("mission");
   /// initialize robot mission to do nothing (wait for mission lines)
   missionInit();
   /// start (the empty) mission, ready for mission snippets.
-  bridge->send("start\n"); // ask REGBOT to start controlled run (ready to execute)
-  bridge->send("oled 3 waiting for REGBOT\n");
+  io.send("start\n"); // ask REGBOT to start controlled run (ready to execute)
+  io.send("oled 3 waiting for REGBOT\n");
 //   play.say("Waiting for robot data.", 100);
   ///
   for (int i = 0; i < 3; i++)
   {
-    if (not bridge->info->isHeartbeatOK())
+    if (not io.isHeartbeatOK())
     { // heartbeat should come at least once a second
-      sleep(2);
+      io.sleep(2000000);
     }
   }
-  if (not bridge->info->isHeartbeatOK())
+  if (not io.isHeartbeatOK())
   { // heartbeat should come at least once a second
     play.say("Oops, no usable connection with robot.", 100);
 //    system("espeak \"Oops, no usable connection with robot.\" -ven+f4 -s130 -a60 2>/dev/null &"); 
-    bridge->send("oled 3 Oops: Lost REGBOT!");
+    io.send("oled 3 Oops: Lost REGBOT!");
     printf("# ---------- error ------------\n");
     printf("# No heartbeat from robot. Bridge or REGBOT is stuck\n");
 //     printf("# You could try restart ROBOBOT bridge ('b' from mission console) \n");
@@ -190,28 +382,33 @@ void UMission::runMission()
       // for debug - allow this
       stop();
   }
+  UTracer::missionState(mission, missionState);
   /// loop in sequence every mission until they report ended
   while (not finished and not th1stop)
   { // stay in this mission loop until finished
     loop++;
+    loopMetric->add();
+    if (snippetTrace.waitingForMotion())
+      // first motion of the latest snippet
+      snippetTrace.velocity(io.velocity(), io.now());
     // test for manuel override (joy is short for joystick or gamepad)
-    if (bridge->joy->manual)
+    if (io.joyManual())
     { // just wait, do not continue mission
-      usleep(20000);
+      io.sleep(20000);
       if (not inManual)
       {
 //         system("espeak \"Mission paused.\" -ven+f4 -s130 -a40 2>/dev/null &"); 
         play.say("Paused.", 90);
       }
       inManual = true;
-      bridge->send("oled 3 GAMEPAD control\n");
+      io.send("oled 3 GAMEPAD control\n");
     }
     else
     { // in auto mode
       if (not regbotStarted)
       { // wait for start event is received from REGBOT
          // - in response to 'bot->send("start\n")' earlier
-        if (bridge->event->isEventSet(33))
+        if (io.isEventSet(33))
         { // start mission (button pressed)
 //           printf("Mission::runMission: starting mission (part from %d to %d)\n", fromMission, toMission);
           regbotStarted = true;
@@ -224,7 +421,7 @@ void UMission::runMission()
           inManual = false;
 //           system("espeak \"Mission resuming.\" -ven+f4 -s130 -a40 2>/dev/null &");
           play.say("Mission resuming", 90);
-          bridge->send("oled 3 running AUTO\n");
+          io.send("oled 3 running AUTO\n");
         }
         switch(mission)
         {
@@ -260,7 +457,10 @@ void UMission::runMission()
           UTime t;
           t.now();
           snprintf(s, MSL, "oled 4 mission %d state %d\n", mission, missionState);
-          bridge->send(s);
+          partMetric->set(mission);
+          stateMetric->set(missionState);
+          UTracer::missionState(mission, missionState);
+          io.send(s);
           if (logMission != NULL)
           {
             fprintf(logMission, "%ld.%03ld %d %d\n", 
@@ -271,6 +471,11 @@ void UMission::runMission()
                     t.getSec(), t.getMilisec(),
                     mission, missionState
             );
+            if (mission != missionOld)
+            { // stage timing for the finished mission part
+              UTiming::logStats(logMission);
+              UPerfCount::logAll(logMission);
+            }
           }
           missionOld = mission;
           missionStateOld = missionState;
@@ -282,7 +487,7 @@ void UMission::runMission()
     // gamepad buttons 0=green, 1=red, 2=blue, 3=yellow, 4=LB, 5=RB, 6=back, 7=start, 8=Logitech, 9=A1, 10 = A2
     // gamepad axes    0=left-LR, 1=left-UD, 2=LT, 3=right-LR, 4=right-UD, 5=RT, 6=+LR, 7=+-UD
     // see also "ujoy.h"
-    if (bridge->joy->button[BUTTON_RED])
+    if (io.joyButton(BUTTON_RED))
     { // red button -> save image
       if (not cam->saveImage)
       {
@@ -290,7 +495,7 @@ void UMission::runMission()
         cam->saveImage = true;
       }
     }
-    if (bridge->joy->button[BUTTON_YELLOW])
+    if (io.joyButton(BUTTON_YELLOW))
     { // yellow button -> make ArUco analysis
       if (not cam->doArUcoAnalysis)
       {
@@ -299,7 +504,7 @@ void UMission::runMission()
       }
     }
     // are we finished - event 0 disables motors (e.g. green button)
-    if (bridge->event->isEventSet(0))
+    if (io.isEventSet(0))
     { // robot say stop
       finished = true;
       printf("Mission:: insist we are finished\n");
@@ -307,19 +512,21 @@ void UMission::runMission()
     else if (mission > toMission)
     { // stop robot
       // make an event 0
-      bridge->send("stop\n");
+      io.send("stop\n");
       // stop mission loop
       finished = true;
     }
-    // release CPU a bit (10ms)
-    usleep(10000);
+    // release CPU until the next REGBOT event (at most 10ms)
+    io.waitNewEvent(10000);
   }
-  bridge->send("stop\n");
-  snprintf(s, MSL, "Robot %s finished.\n", bridge->info->robotname);
+  io.send("stop\n");
+  snprintf(s, MSL, "Robot %s finished.\n", io.robotName());
 //   system(s); 
   play.say(s, 100);
   printf("%s", s);
-  bridge->send("oled 3 finished\n");
+  io.send("oled 3 finished\n");
+  // finish recording (if any)
+  io.close();
 }
 
 
@@ -645,573 +852,567 @@ bool UMission::mission1(int & state)
 }
 */
 
-//All the missions together
-bool UMission::mission1(int & state)
+/**
+ * Mission 1 segment - from start to up the ramp */
+static constexpr const char * segRamp[] =
 {
-	bool finished = false;
-	
-	switch (state){
-		case 0:
-		printf("# press green to start.\n");
-		play.say("Press green to start", 90);
-		bridge->send("oled 5 press green to start");
-		state++;
-		break;
-		
-		case 1:
-		if (bridge->joy->button[BUTTON_GREEN]){
-			state = 10; //NEEDS TO BE 10
-		}
-		break;
-		
-		
-		case 10:
-		{
-			//Mission 1 - From start to up the ramp
-			printf("# Mission1.\n");
-			play.say("Running mission 1.", 90);
-			
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.6,acc=3,edgel=0,white=1:dist=4.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.6,acc=3,edgel=0,white=1:dist=15,xl>1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4,tr=0.2:turn=80.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3,edger=0.0,white=1:dist=0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3,acc=3: time=2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3,edger=0.0,white=1:dist=0.9");
-			snprintf(lines[line++], MAX_LEN, "vel=0.15,edger=0.0,white=1:time=15.0, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2,acc=3.0:dist=0.15");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.35,acc=3.0:time=1.5");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2, acc=3.0: dist=0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, tr=0.1: turn=-60.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.5, acc=3: dist=1.65, xl>1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.5, acc=3: dist=0.1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, acc=3: dist=2.0, xl>1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.25, tr=0.0: turn=-95.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edger=0, white=1: dist=0.10");
-			snprintf(lines[line++], MAX_LEN, "vel=0.8, acc=3, edger=0, white=1: dist=2.86");
-			
-			snprintf(lines[line++], MAX_LEN, "event=1,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			
-			//Mission 1 end
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(1);
-
-			printf("# case=%d sent mission snippet 1\n", state);
-			bridge->send("oled 5 code snippet 1");
-
-			state = 11;
-			featureCnt = 0;
-		}
-		case 11:
-		{
-			if (bridge->event->isEventSet(1)){
-				state = 12;
-			}
-			break;
-		}
-		case 12:
-		{
-			//Mission 2 - Get the ball
-			printf("# Mission2.\n");
-			play.say("Running mission 2.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edger=0, white=1: dist=0.10");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edger=0, white=1: dist=1, xl=1, lv<1");  // finds crosslines LINK CAP A LES ESCALES
-			snprintf(lines[line++], MAX_LEN, "vel=0.0:time=2");
-			//snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");  
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, tr=0.1:turn=-69"); //pick up the ball from crosslines
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=245, vservo=180");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4,tr=0.1:turn=-118");   //-118
-			snprintf(lines[line++], MAX_LEN, "vel=0.3:dist=0.60");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=2");
-
-			//sweeping
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=40");
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=-65"); 
-			snprintf(lines[line++], MAX_LEN, "vel=0:time=0.05");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.27:dist=0.04");
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=65");
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=-65");
-			snprintf(lines[line++], MAX_LEN, "vel=0:time=0.05");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.27:dist=0.04");
-			
-			snprintf(lines[line++], MAX_LEN, "event=2,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-
-			
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(2);
-
-			printf("# case=%d sent mission snippet 2\n", state);
-			bridge->send("oled 5 code snippet 2");
-
-			state = 13;
-			featureCnt = 0;
-			break;
-		}
-		case 13:
-		{
-			if (bridge->event->isEventSet(2)){
-				state = 14;
-				
-			}
-			break;
-		}
-
-		case 14: 
-		{
-			//Mission 3 
-			printf("# Mission2.\n");
-			play.say("Running mission 14 dawg.", 90);
-
-			int line = 0;
-			
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=250, vservo=180");
-			
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=70");
-			snprintf(lines[line++], MAX_LEN, "tr=0, vel=-0.23, acc=1: turn=-70");		//sweepign
-			snprintf(lines[line++], MAX_LEN, "vel=0:time=0.05");
-			//snprintf(lines[line++], MAX_LEN, "vel=-0.3:dist=0.04");
-			
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");	// get back to white line
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.12");						//HERE DISTANCE   (IF IT DOESN'T HIT THE WHITE LINE AFTER GETTING THE BALL IN change)
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3, tr=0.25: turn=-70"); //115
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=0.1");	
-
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edger=0, white=1: dist=0.10"); //find edge
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edger=0, white=1: dist=1, xl=1, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.25, acc=3: dist=0.28"); //0.33
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, tr=0.25: turn=-85"); //point towards the stairs
-
-			//snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.1");   //MAYBE DELETE THIS?
-			
-			snprintf(lines[line++], MAX_LEN, "event=3,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(3);
-
-			printf("# case=%d sent mission snippet 2\n", state);
-			bridge->send("oled 5 code snippet 2");
-
-			state = 15;
-			featureCnt = 0;
-			break;
-
-		}
-
-		case 15:
-		{
-			if (bridge->event->isEventSet(3)){
-				state = 16;
-				
-			}
-			break;
-		}
-		
-		
-		case 16: //down the stairs
-		{
-			//Mission 3 - Down the stairs
-			printf("# Mission2.\n");
-			play.say("Running mission 14.", 90);
-
-			int line = 0;
-			
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-900, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=5, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0: time=1");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3, acc=3.0: time=1.5"); //1a escala
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0: time=1");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3, acc=3.0: time=1.5"); // 2a escala
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.25, acc=3.0: time=1");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3, acc=3.0: time=1.5"); // 3a escala
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0: time=1");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3, acc=3.0: time=1.5"); //4a escala
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1"); //THIS
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3: time=2");  //THIS
-
-			//snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3: time=1.5");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3: time=4"); //5a escala
-
-			//snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1");
-			//snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3.0: time=1.2");
-			//snprintf(lines[line++], MAX_LEN, "vel=-0.4, tr=0.1: turn=8");
-			//snprintf(lines[line++], MAX_LEN, "vel=-0.3: time=3");
-
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, acc=3, edgel=0, white=1: dist=0.10");
-			snprintf(lines[line++], MAX_LEN, "vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1");
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.6,acc=3,edgel=0,white=1:dist=4.0",
+	"vel=0.6,acc=3,edgel=0,white=1:dist=15,xl>1",
+	"vel=0.4,tr=0.2:turn=80.0",
+	"vel=0.3,edger=0.0,white=1:dist=0.3",
+	"vel=-0.3,acc=3: time=2",
+	"vel=0.3,edger=0.0,white=1:dist=0.9",
+	"vel=0.15,edger=0.0,white=1:time=15.0, lv<1",
+	"vel=0.2,acc=3.0:dist=0.15",
+	"vel=-0.35,acc=3.0:time=1.5",
+	"vel=0.2, acc=3.0: dist=0.3",
+	"vel=0.3, tr=0.1: turn=-60.0",
+	"vel=0.5, acc=3: dist=1.65, xl>1",
+	"vel=0.5, acc=3: dist=0.1",
+	"vel=0.4, acc=3: dist=2.0, xl>1",
+	"vel=0.25, tr=0.0: turn=-95.0",
+	"vel=0.3, acc=3, edger=0, white=1: dist=0.10",
+	"vel=0.8, acc=3, edger=0, white=1: dist=2.86",
+
+	"event=1,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - get the ball */
+static constexpr const char * segBall[] =
+{
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.3, acc=3, edger=0, white=1: dist=0.10",
+	"vel=0.3, acc=3, edger=0, white=1: dist=1, xl=1, lv<1",  // finds crosslines LINK CAP A LES ESCALES
+	"vel=0.0:time=2",
+	//"servo=2, pservo=-850, vservo=200",  
+	"vel=0.3, tr=0.1:turn=-69", //pick up the ball from crosslines
+	"servo=2, pservo=245, vservo=180",
+	"vel=0.0: time=2",
+	"vel=0.4,tr=0.1:turn=-118",   //-118
+	"vel=0.3:dist=0.60",
+	"vel=0.0: time=2",
+
+	//sweeping
+	"tr=0, vel=-0.23, acc=1: turn=40",
+	"tr=0, vel=-0.23, acc=1: turn=-65", 
+	"vel=0:time=0.05",
+	"vel=-0.27:dist=0.04",
+	"tr=0, vel=-0.23, acc=1: turn=65",
+	"tr=0, vel=-0.23, acc=1: turn=-65",
+	"vel=0:time=0.05",
+	"vel=-0.27:dist=0.04",
+
+	"event=2,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - sweep the ball in, to the stairs */
+static constexpr const char * segSweep[] =
+{
+	"servo=2, pservo=250, vservo=180",
 
-			snprintf(lines[line++], MAX_LEN, "event=4,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(4);
+	"tr=0, vel=-0.23, acc=1: turn=70",
+	"tr=0, vel=-0.23, acc=1: turn=-70",		//sweepign
+	"vel=0:time=0.05",
+	//"vel=-0.3:dist=0.04",
 
-			printf("# case=%d sent mission snippet 2\n", state);
-			bridge->send("oled 5 code snippet 2");
+	"servo=2, pservo=-850, vservo=200",	// get back to white line
+	"vel=0.3: dist=0.12",						//HERE DISTANCE   (IF IT DOESN'T HIT THE WHITE LINE AFTER GETTING THE BALL IN change)
+	"vel=-0.3, tr=0.25: turn=-70", //115
+	"vel=0.2: dist=0.1",	
 
-			state = 17;
-			featureCnt = 0;
-			break;
+	"vel=0.3, acc=3, edger=0, white=1: dist=0.10", //find edge
+	"vel=0.3, acc=3, edger=0, white=1: dist=1, xl=1, lv<1",
+	"vel=-0.25, acc=3: dist=0.28", //0.33
+	"vel=0.3, tr=0.25: turn=-85", //point towards the stairs
 
-		}
+	//"vel=0.3: dist=0.1",   //MAYBE DELETE THIS?
 
-		case 17: /// DONT CHANGE ANYTHING HERE
-		{
-			if (bridge->event->isEventSet(4)){
-				state = 18;
-				
-			}
-			break;
-		}
+	"event=3,vel=0.0",
+	": dist=1",
+};
 
-		case 18:
-		{
-			//Mission 3 - From the floor after the last stair (green part)
-			printf("# Mission3.\n");
-			play.say("Laura is the best.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-900, vservo=200");
-			
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.4");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: time=3");
-			
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.262");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=85.0");     //FIRST TREE  (89)
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=200, vservo=200"); //THIS
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=1.20");
-			snprintf(lines[line++], MAX_LEN, "vel=0.25, tr=0.1: turn=4");    
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=0.21");				//ldeixa la bola
-			snprintf(lines[line++], MAX_LEN, "vel=-0.2: dist=0.42");			
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90.0");	
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: time=3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=1.4");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: time=4");
-			
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.665");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=83");     //SECOND TREE (MOVE THIS UP AGAIN)
-			
-			snprintf(lines[line++], MAX_LEN, "event=5,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1"); //This line is needed for now.
-			//Mission 3 end
-			
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(5);
-
-			printf("# case=%d sent mission snippet 3\n", state);
-			bridge->send("oled 5 code snippet 3");
-
-			state = 19;
-			featureCnt = 0;
+/**
+ * Mission 1 segment - down the stairs */
+static constexpr const char * segStairs[] =
+{
+	"servo=2, pservo=-900, vservo=200",
+	"vel=0.3, acc=3.0, edgel=0,white=1: time=5, lv<1",
+	"vel=0.3, acc=3.0: time=1",
+	"vel=-0.3, acc=3.0: time=1.5", //1a escala
+	"vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1",
+	"vel=0.3, acc=3.0: time=1",
+	"vel=-0.3, acc=3.0: time=1.5", // 2a escala
+	"vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1",
+	"vel=0.25, acc=3.0: time=1",
+	"vel=-0.3, acc=3.0: time=1.5", // 3a escala
+	"vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1",
+	"vel=0.3, acc=3.0: time=1",
+	"vel=-0.3, acc=3.0: time=1.5", //4a escala
+	"vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1", //THIS
+	"vel=0.3, acc=3: time=2",  //THIS
+
+	//"vel=0.3, acc=3: time=1.5",
+	"vel=-0.3: time=4", //5a escala
+
+	//"vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1",
+	//"vel=0.3, acc=3.0: time=1.2",
+	//"vel=-0.4, tr=0.1: turn=8",
+	//"vel=-0.3: time=3",
+
+	"vel=0.3, acc=3, edgel=0, white=1: dist=0.10",
+	"vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1",
+
+	"event=4,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - from the floor after the last stair (green part) */
+static constexpr const char * segTrees[] =
+{
+	"servo=2, pservo=-900, vservo=200",
+
+	"vel=0.3: dist=0.4",
+	"vel=0.4, tr=0.1: turn=-90.0",
+	"vel=-0.4: time=3",
+
+	"vel=0.4: dist=0.262",
+	"vel=0.4, tr=0.1: turn=85.0",     //FIRST TREE  (89)
+	"servo=2, pservo=200, vservo=200", //THIS
+	"vel=0.4: dist=0.3",
+	"vel=0.2: dist=1.20",
+	"vel=0.25, tr=0.1: turn=4",    
+	"vel=0.2: dist=0.21",				//ldeixa la bola
+	"vel=-0.2: dist=0.42",			
+	"vel=0.4, tr=0.1: turn=-90.0",	
+	"servo=2, pservo=-850, vservo=200",
+	"vel=-0.4: time=3",
+	"vel=0.4: dist=0.2",
+	"vel=0.4, tr=0.1: turn=-90.0",
+	"vel=0.4: dist=1.4",
+	"vel=0.4, tr=0.1: turn=90.0",
+	"vel=-0.4: time=4",
+
+	"vel=0.4: dist=0.665",
+	"vel=0.4, tr=0.1: turn=83",     //SECOND TREE (MOVE THIS UP AGAIN)
+
+	"event=5,vel=0.0",
+	": dist=1", //This line is needed for now.
+};
+
+/**
+ * Mission 1 segment - tree stuff and little box stuff */
+static constexpr const char * segBox[] =
+{
+	"servo=2, pservo=200, vservo=200",
+
+	"vel=0.2: dist=1.2",
+	"vel=0.3, tr=0.1: turn=12",
+	"vel=0.2: dist=0.57", //cap al aruc, (0.54)
+	"vel=-0.4: dist=0.34",
+	"vel=0.4, tr=0.1: turn=-90",
+	"servo=2, pservo=-900, vservo=200",
+
+	"vel=-0.4: time=5",	 //NEW
+	"vel=0.4: dist=1.2",	//NEW  (1.35)
+
+	//"vel=0.3: dist=0.31",					//0.313
+	"vel=0.4, tr=0.1: turn=-88",
+	"vel=0: time=2", 
+
+	"servo=2, pservo=260, vservo=200", //Box mission starts here
+	"vel=0.73: dist=0.75",
+	"vel=0: time=2",
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.4, tr=0.1: turn=90.0",
+	"vel=0.4: dist=0.2",
+	"vel=0.4, tr=0.1: turn=83.0", //fine tune to drive inside box
+	"vel=0.35: dist=1.1", //inside box
+	"vel=0.4, tr=0.1: turn=-90.0",
+
+	"event=6,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - finish the little box until the racetrack */
+static constexpr const char * segGates[] =
+{
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.4: dist=0.3",
+	"vel=0.4, tr=0.1: turn=-85.0",
+	"vel=0.4: dist=1.05",
+	"vel=0.4, tr=0.1: turn=-84.0",
+	"vel=0: time=2",
+	"vel=0.7: dist=0.35",
+	"vel=0: time=2",
+	"vel=0.3, tr=0.1: turn=-85.0",
+	"vel=0.2: time=4", //closes 1st gate
+	"vel=-0.3: dist=0.4", 
+	"vel=0.4, tr=0.1: turn=85.0",
+	"vel=0.3: dist=0.6",
+	"vel=0.4, tr=0.1: turn=-87.0",
+	"vel=0.3: dist=1.12", //distance to maybe fine tune
+	"vel=0.4, tr=0.1: turn=-87.0",
+	"vel=0.4: dist=0.76",          //0.83  (78) IF THE ROBOT GOES TOO FAR, BEFORE WE TURN TO THE RACE TRACK)
+	"vel=0.4, tr=0.1: turn=85.0",
+	"vel=-0.3: time=5",
+
+	//"vel=0.4: dist=0.1",
+	//"vel=0.4, tr=0.1: turn=-10",   //LAST TURN
+	//"vel=0.4: dist=0.52",   //DISTANCE FROM THE LAST TURN TO THE RACETRACK PART (Might need to change)?
+
+	"event=7,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - racetrack */
+static constexpr const char * segRacetrack[] =
+{
+	"servo=2, pservo=-900, vservo=200",
+	////// NEW CODE to look towards the white line
+
+	"vel=0.4, tr=0.1: turn=90.0",
+	"vel=-0.4: time=4",
+	"vel=0.3: dist=0.45",
+	"vel=0.4, tr=0.1: turn=-90.0",
+	"vel=0.3: dist=0.7",
+	//// 
+	"vel=0.4, acc=2, edger=0, white=1: dist=2.02, lv<1", //distance might need to change 2.45
+	//snprintf(lines[line++], MAX_LEN, "vel=0: time=0.5);
+	"vel=0.0: time=20.0, ir2<0.35", //0.35
+	"vel=0.0: time=20.0, ir2>0.35", // 0.35
+	//"vel=0: time=0.4",
+	"vel=1.6, acc=5, edger=0, white=1: dist=1, lv<1",
+	"vel=1.5, acc=5, edger=0, white=1: dist=10, lv<1, ir1<0.3",
+	"vel=1.5, acc=5, edger=0, white=1: dist=0.1",
+	"vel=1.5, acc=5, edger=0, white=1: dist=10, lv<1, ir1<0.3",
+
+	"event=8,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - end of the racetrack till looking at the carousel */
+static constexpr const char * segCarousel[] =
+{
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.2: dist=0.1",
+	"vel=0.0: time=2",
+	"vel=-0.4, tr=0.1: turn =-90",
+	"vel=0.4, tr=0.1: turn=-90",
+	"vel=0.2, edgel=0,white=1: dist=0.10", // this line was added NOW
+	// edge leg with velocity from camera look-ahead (event 25 when started)
+	"event=25, vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1, xl>15",
+	"vel=0.4, tr=0.1: turn=120", //127   (124)  (This is the turn looking into the causel - change if the robot can't get up into the causel)
+	"vel=0.0: time=20.0, ir2<0.4",
+	"vel=0.0: time=20.0, ir2>0.4",
+	"vel=0.0: time=1",
+	"vel=0.8: dist=1.03",  //vel=0.9
+	"vel=0.0: time=1", //new line added
+
+	"event=9,vel=0.0",
+	": dist=1",
+};
+
+/**
+ * Mission 1 segment - carousel to finish (roundabout) */
+static constexpr const char * segRoundabout[] =
+{
+	"servo=2, pservo=-850, vservo=200",
+	"vel=0.4, tr=0.1:turn=-56", //63 (60)
+	"vel=0.4: dist=0.18",  //(0.18)
+	"vel=0.4, tr=0.1: turn=38", //37
+	"vel=0.3: dist=0.30",
+	"vel=0.4, tr=0.1: turn=65",
+	"vel=0.3: dist=0.32",
+	"vel=0.4, tr=0.1: turn=69",
+	"vel=0.3: dist=0.33",
+	"vel=0.4, tr=0.1: turn=70",
+	"vel=0.4: dist=0.32",
+	"vel=0.4, tr=0.1: turn=-48",
+	"vel=0.4:dist=0.05",
+	"vel=0.0: time=20.0, ir2<0.5",
+	"vel=0.0: time=20.0, ir2>0.5",
+	"vel=0.0: time=3",
+	"vel=0.4: dist=0.28",
+	"vel=0.4, tr=0.1: turn=-92",
+	"vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1, xl>15",
+	"vel=0.4, tr=0.1: turn=145",
+	"vel=0.5: dist=0.3",
+	"vel=0.5, edgel=0, white=1: dist=0.5, lv<1",
+
+	"event=10,vel=0.0",
+	": dist=1",
+};
+
+
+/**
+ * A mission 1 segment: one snippet, ending with 'event=N' */
+struct USegment
+{
+	/// state that sends the snippet, the next state waits for the event
+	int state;
+	const char * name;
+	/// console text at segment start (as before the table)
+	const char * log;
+	const char * say;
+	const char * const * text;
+	int lineCnt;
+	/// completion event
+	int event;
+	/// edge leg with look-ahead velocity (line with 'event=25'), else not preloaded
+	bool lookAhead;
+};
+
+static constexpr USegment segments1[] =
+{
+	{10, "ramp", "Mission1", "Running mission 1.", segRamp, std::size(segRamp), 1, false},
+	{12, "ball", "Mission2", "Running mission 2.", segBall, std::size(segBall), 2, false},
+	{14, "sweep", "Mission2", "Running mission 14 dawg.", segSweep, std::size(segSweep), 3, false},
+	{16, "stairs", "Mission2", "Running mission 14.", segStairs, std::size(segStairs), 4, false},
+	{18, "trees", "Mission3", "Laura is the best.", segTrees, std::size(segTrees), 5, false},
+	{20, "box", "Mission4", "Running mission 20.", segBox, std::size(segBox), 6, false},
+	{22, "gates", "Mission4", "Running mission 3.", segGates, std::size(segGates), 7, false},
+	{24, "racetrack", "Mission4", "Running mission 4.", segRacetrack, std::size(segRacetrack), 8, false},
+	{26, "carousel", "Mission4", "Running mission 3.", segCarousel, std::size(segCarousel), 9, true},
+	{28, "roundabout", "Mission5", "Running mission 5.", segRoundabout, std::size(segRoundabout), 10, false},
+};
+
+static constexpr int segments1Cnt = std::size(segments1);
+
+/**
+ * Preloaded segments.
+ * A segment is preloaded into REGBOT thread 110 + i, and the thread stops
+ * itself at the segment completion event. The first is started by event 11,
+ * the next ones by the completion event of the segment before, so they run
+ * back to back on the REGBOT.
+ * Only segments after a preloaded segment can be preloaded: a just-in-time
+ * segment in thread 100/101 keeps running its last line until the other of
+ * 100/101 is started. */
+static const int preloadThread = 110;
+static const int preloadEvent = 11;
+/// REGBOT mission lines to use for preloaded segments
+static const int preloadLineMax = 200;
+static bool preloaded1[segments1Cnt];
+
+/// next REGBOT label for repeat blocks (unique in the REGBOT mission)
+static int snippetLabel = 1;
+
+/**
+ * Next just-in-time segment, uploaded to the inactive thread (100 or 101)
+ * while the current segment is driving, -1 if none */
+static int staged1 = -1;
+static int stagedThread1 = 0;
+static int stagedEvent1 = 0;
+
+static void preloadSegments()
+{
+	int used = 0;
+	bool disabled = getenv("MISSION_NO_PRELOAD") != NULL;
+	for (int i = 0; i < segments1Cnt; i++)
+	{
+		const USegment & seg = segments1[i];
+		// a segment from the bundle file may change while running
+		bool inBundle = bundle.isLoaded() and bundle.get()->find(seg.state) != nullptr;
+		preloaded1[i] = not disabled and not seg.lookAhead and not inBundle and
+		                (i == 0 or preloaded1[i - 1]);
+		if (not preloaded1[i])
+			continue;
+		// expand repeat blocks
+		const int MPL = 60;
+		const int MLL = 120;
+		char buf[MPL][MLL];
+		char * text[MPL];
+		for (int j = 0; j < MPL; j++)
+			text[j] = buf[j];
+		int cnt = USnippetCode::expand(seg.text, seg.lineCnt, text, MPL, MLL, snippetLabel);
+		float saved;
+		if (cnt > 0)
+			cnt = snippetOpt.optimise(text, cnt, MLL, saved);
+		if (cnt <= 0 or used + cnt > preloadLineMax)
+		{ // this and the rest just in time
+			for (int j = i; j < segments1Cnt; j++)
+				preloaded1[j] = false;
 			break;
 		}
-		
-		case 19:
+		const int MSL = 150;
+		char s[MSL];
+		// the first is started by the host, the rest by the completion
+		// event of the previous segment, with no host round trip
+		int startEvent = preloadEvent;
+		if (i > 0)
+			startEvent = segments1[i - 1].event;
+		snprintf(s, MSL, "robot <add thread=%d,event=%d : event=%d\n",
+		         preloadThread + i, startEvent, seg.event);
+		io.send(s);
+		for (int j = 0; j < cnt; j++)
 		{
-			if (bridge->event->isEventSet(5)){
-				state = 20;
-				
-			}
-			break;
+			snprintf(s, MSL, "robot <add %s\n", text[j]);
+			io.send(s);
 		}
-		
-		case 20:
-		{
-			//Mission 4 - Tree stuff and little box stuff
-			printf("# Mission4.\n");
-			play.say("Running mission 20.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=200, vservo=200");
-			
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=1.2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, tr=0.1: turn=12");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=0.57"); //cap al aruc, (0.54)
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: dist=0.34");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90");
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-900, vservo=200");
-			
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: time=5");	 //NEW
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=1.2");	//NEW  (1.35)
-			
-			//snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.31");					//0.313
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-88");
-			snprintf(lines[line++], MAX_LEN, "vel=0: time=2"); 
-			
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=260, vservo=200"); //Box mission starts here
-			snprintf(lines[line++], MAX_LEN, "vel=0.73: dist=0.75");
-			snprintf(lines[line++], MAX_LEN, "vel=0: time=2");
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=83.0"); //fine tune to drive inside box
-			snprintf(lines[line++], MAX_LEN, "vel=0.35: dist=1.1"); //inside box
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90.0");
-			
-			snprintf(lines[line++], MAX_LEN, "event=6,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			//Mission 3 end
-			
-
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(6);
-
-			printf("# case=%d sent mission snippet 3\n", state);
-			bridge->send("oled 5 code snippet 3");
+		used += cnt;
+	}
+	printf("# preloaded %d REGBOT mission lines\n", used);
+}
 
-			state = 21;
-			featureCnt = 0;
-			break;
-		}
-		
-		case 21:
-		{
-			if (bridge->event->isEventSet(6)){
-				state = 22;
-				
+//All the missions together
+bool UMission::mission1(int & state)
+{
+	if (machine1.empty())
+	{ // build the state table at first call
+		machine1.add(0, "prompt").onEnter([this]() {
+			printf("# press green to start.\n");
+			play.say("Press green to start", 90);
+			io.send("oled 5 press green to start");
+		}).to(1);
+		machine1.add(1, "wait green").when([]() { return io.joyButton(BUTTON_GREEN); }, 10);
+		// copy segment to lines
+		auto loadLines = [this](const USegment & seg) {
+			// the bundle version at segment start is used for the whole segment
+			std::shared_ptr<const UMissionBundle::UBundle> b = bundle.get();
+			const UMissionBundle::USegment * bs = b ? b->find(seg.state) : nullptr;
+			const char * const * text = seg.text;
+			int textCnt = seg.lineCnt;
+			if (bs != nullptr and bs->event == seg.event)
+			{
+				text = bs->text.data();
+				textCnt = bs->text.size();
+				printf("# case=%d from %s version %d\n", seg.state, b->file.c_str(), b->version);
 			}
-			break;
-		}
-		
-		case 22:
-		{
-			//Mission 5 - finish the little box until the racetrack
-			printf("# Mission4.\n");
-			play.say("Running mission 3.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-85.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=1.05");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-84.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0: time=2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.7: dist=0.35");
-			snprintf(lines[line++], MAX_LEN, "vel=0: time=2");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3, tr=0.1: turn=-85.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: time=4"); //closes 1st gate
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3: dist=0.4"); 
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=85.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.6");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-87.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=1.12"); //distance to maybe fine tune
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-87.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.76");          //0.83  (78) IF THE ROBOT GOES TOO FAR, BEFORE WE TURN TO THE RACE TRACK)
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=85.0");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.3: time=5");
-		
-			//snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.1");
-			//snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-10");   //LAST TURN
-			//snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.52");   //DISTANCE FROM THE LAST TURN TO THE RACETRACK PART (Might need to change)?
-
-			snprintf(lines[line++], MAX_LEN, "event=7,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			//Mission 4 end
-			
-
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(7);
-
-			printf("# case=%d sent mission snippet 5\n", state);
-			bridge->send("oled 5 code snippet 4");
-
-			state = 23;
-			featureCnt = 0;
-			break;
-		}
-		
-		case 23:
-		{
-			if (bridge->event->isEventSet(7)){
-				state = 24;
-				
+			else if (bs != nullptr)
+				printf("# case=%d: %s segment has event %d, not %d - not used\n",
+				       seg.state, b->file.c_str(), bs->event, seg.event);
+			int cnt = USnippetCode::expand(text, textCnt, lines, missionLineMax,
+			                               MAX_LEN, snippetLabel);
+			return std::max(cnt, 0);
+		};
+		// set up the look-ahead leg from the segment in lines, when the segment starts
+		auto startLookAhead = [this](int cnt) {
+			int legLine = -1;
+			for (int j = 0; j < cnt; j++)
+			{
+				if (strncmp(lines[j], "event=25", 8) == 0)
+					legLine = j;
 			}
-			break;
-		} 
-		
-		case 24:
-		{
-			//Mission 4 - Racetrack
-			printf("# Mission4.\n");
-			play.say("Running mission 4.", 90);
-
-			int line = 0;
-
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-900, vservo=200");
-			////// NEW CODE to look towards the white line
-	
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4: time=4");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.45");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90.0");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.7");
-			//// 
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, acc=2, edger=0, white=1: dist=2.02, lv<1"); //distance might need to change 2.45
-			//snprintf(lines[line++], MAX_LEN, "vel=0: time=0.5);
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2<0.35"); //0.35
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2>0.35"); // 0.35
-			//snprintf(lines[line++], MAX_LEN, "vel=0: time=0.4");
-			snprintf(lines[line++], MAX_LEN, "vel=1.6, acc=5, edger=0, white=1: dist=1, lv<1");
-			snprintf(lines[line++], MAX_LEN, "vel=1.5, acc=5, edger=0, white=1: dist=10, lv<1, ir1<0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=1.5, acc=5, edger=0, white=1: dist=0.1");
-			snprintf(lines[line++], MAX_LEN, "vel=1.5, acc=5, edger=0, white=1: dist=10, lv<1, ir1<0.3");
-			
-			snprintf(lines[line++], MAX_LEN, "event=8,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			//Mission 3 end
-			
-
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(8);
-
-			printf("# case=%d sent mission snippet 3\n", state);
-			bridge->send("oled 5 code snippet 3");
-
-			state = 25;
-			featureCnt = 0;
-			break;
-		}
-		
-		case 25:
-		{
-			if (bridge->event->isEventSet(8)){
-				state = 26;
-				
+			if (legLine >= 0 and
+			    // keep the rest of the segment, the leg may be replaced while driving
+			    lookLegSetup(lookLeg, lines[legLine], &lines[legLine + 1], cnt - legLine - 1))
+			{
+				lineLook.start([](cv::Mat & img) { return io.capture(img); });
+				io.clearEvent(25);
 			}
-			break;
-		}
-		
-		
-		case 26:
+		};
+		for (int i = 0; i < segments1Cnt; i++)
 		{
-			//Mission 4 - End of the racetrack till looking at the causel
-			printf("# Mission4.\n");
-			play.say("Running mission 3.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2: dist=0.1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=2");
-			snprintf(lines[line++], MAX_LEN, "vel=-0.4, tr=0.1: turn =-90");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-90");
-			snprintf(lines[line++], MAX_LEN, "vel=0.2, edgel=0,white=1: dist=0.10"); // this line was added NOW
-			snprintf(lines[line++], MAX_LEN, "vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1, xl>15");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=120"); //127   (124)  (This is the turn looking into the causel - change if the robot can't get up into the causel)
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2<0.4");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2>0.4");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=1");
-			snprintf(lines[line++], MAX_LEN, "vel=0.8: dist=1.03");  //vel=0.9
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=1"); //new line added
-
-			snprintf(lines[line++], MAX_LEN, "event=9,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			//Mission 4 end
-			
-
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(9);
-
-			printf("# case=%d sent mission snippet 5\n", state);
-			bridge->send("oled 5 code snippet 4");
-
-			state = 27;
-			featureCnt = 0;
-			break;
+			const USegment & seg = segments1[i];
+			int next = 999;
+			if (i < segments1Cnt - 1)
+				next = segments1[i + 1].state;
+			machine1.add(seg.state, seg.name).onEnter([this, &seg, i, loadLines, startLookAhead]() {
+				printf("# %s.\n", seg.log);
+				play.say(seg.say, 90);
+				const int MSL = 50;
+				char s[MSL];
+				const char * how = "sent";
+				// clear old completion event before the segment is started, a chained
+				// segment is started by the REGBOT, so cleared with the previous one
+				if (i == 0 or not preloaded1[i])
+					io.clearEvent(seg.event);
+				if (i + 1 < segments1Cnt and preloaded1[i + 1])
+					io.clearEvent(segments1[i + 1].event);
+				if (preloaded1[i])
+				{ // in the REGBOT already
+					snippetTrace.begin(mission, missionState, seg.text, seg.lineCnt, io.now());
+					snippetTrace.sent(io.now());
+					if (i == 0)
+					{ // the first is started from here
+						snprintf(s, MSL, "<event=%d\n", preloadEvent);
+						io.send(s);
+						how = "started preloaded";
+					}
+					else
+						// started by the REGBOT at the completion event of the previous segment
+						how = "chained";
+					snippetTrace.activated(io.now());
+				}
+				else if (staged1 == i)
+				{ // uploaded while the previous segment was driving
+					if (seg.lookAhead)
+						// the staged lines are optimised, so the leg tail is from a new copy
+						startLookAhead(loadLines(seg));
+					snippetTrace.begin(mission, missionState, seg.text, seg.lineCnt, io.now());
+					snippetTrace.sent(io.now());
+					snippetLink.activate(stagedEvent1);
+					snippetTrace.activated(io.now());
+					threadActive = stagedThread1;
+					staged1 = -1;
+					how = "activated staged";
+				}
+				else
+				{ // upload just in time
+					int cnt = loadLines(seg);
+					if (seg.lookAhead)
+						startLookAhead(cnt);
+					if (cnt > 0)
+						sendAndActivateSnippet(lines, cnt);
+				}
+				printf("# case=%d %s mission snippet %d\n", seg.state, how, seg.event);
+				snprintf(s, MSL, "oled 5 code snippet %d", seg.event);
+				io.send(s);
+				featureCnt = 0;
+			}).to(seg.state + 1);
+			UStateMachine::UState & wait = machine1.add(seg.state + 1, seg.name);
+			wait.when([&seg]() { return io.isEventSet(seg.event); }, next);
+			if (i + 1 < segments1Cnt and not seg.lookAhead)
+				// the look-ahead leg uses the inactive thread, else stage the next segment there
+				wait.onEnter([this, i, loadLines]() {
+					if (preloaded1[i + 1])
+						return;
+					int cnt = loadLines(segments1[i + 1]);
+					float saved;
+					cnt = snippetOpt.optimise(lines, cnt, MAX_LEN, saved);
+					if (cnt == 0)
+						return;
+					stagedThread1 = threadActive == 101 ? 100 : 101;
+					stagedEvent1 = stagedThread1 == 100 ? 30 : 31;
+					int n = snippetLink.upload(stagedThread1, lines, cnt);
+					snippetLineMetric->add(n);
+					snippetMetric->add();
+					if (snippetLink.waitAck())
+						staged1 = i + 1;
+				});
 		}
-		
-		case 27:
-		{
-			if (bridge->event->isEventSet(9)){
-				state = 28;
-				
+		// speed up or slow down on the carousel edge leg from the camera look-ahead
+		machine1.add(27, "carousel").onPoll([this]() {
+			if (io.isEventSet(25))
+			{
+				lookLeg.started = true;
+				lookLeg.startDist = io.poseDist();
 			}
-			break;
-		}
-		
-		case 28:
-		{
-			//Mission 5 - Causel to finish (Roundabout)
-			printf("# Mission5.\n");
-			play.say("Running mission 5.", 90);
-
-			int line = 0;
-			snprintf(lines[line++], MAX_LEN, "servo=2, pservo=-850, vservo=200");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1:turn=-56"); //63 (60)
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.18");  //(0.18)
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=38"); //37
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.30");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=65");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.32");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=69");
-			snprintf(lines[line++], MAX_LEN, "vel=0.3: dist=0.33");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=70");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.32");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-48");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4:dist=0.05");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2<0.5");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=20.0, ir2>0.5");
-			snprintf(lines[line++], MAX_LEN, "vel=0.0: time=3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4: dist=0.28");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=-92");
-			snprintf(lines[line++], MAX_LEN, "vel=0.6, acc=3, edgel=0, white=1: dist=10, lv<1, xl>15");
-			snprintf(lines[line++], MAX_LEN, "vel=0.4, tr=0.1: turn=145");
-			snprintf(lines[line++], MAX_LEN, "vel=0.5: dist=0.3");
-			snprintf(lines[line++], MAX_LEN, "vel=0.5, edgel=0, white=1: dist=0.5, lv<1");
-
-			snprintf(lines[line++], MAX_LEN, "event=10,vel=0.0");
-			snprintf(lines[line++], MAX_LEN, ": dist=1");
-			//Mission 5 end
-			
-
-			sendAndActivateSnippet(lines, line);
-			bridge->event->isEventSet(10);
-
-			printf("# case=%d sent mission snippet 6\n", state);
-			bridge->send("oled 5 code snippet 6");
-
-			state = 29;
-			featureCnt = 0;
-			break;
-		}
-		
-		case 29:
-		{
-			if (bridge->event->isEventSet(10)){
-				state = 999;
-				
+			if (lookLegUpdate(lookLeg, io.poseDist()))
+			{ // replace the rest of the leg
+				int line = lookLegFormat(lookLeg, lines, MAX_LEN, io.poseDist());
+				sendAndActivateSnippet(lines, line);
+				printf("# case=27 look-ahead vel=%.2f (curvature %.2f)\n", lookLeg.vel, lineLook.getCurvature());
 			}
-			break;
-		}
-		
-		case 999:
-		printf("Vitus er sej \n");
-		bridge->send("oled 5 \"mission 1 ended.\"");
-		finished = true;
-		break;
-		
-
-		default:
+		}).onExit([]() { lookLeg.active = false; });
+		machine1.add(999, "ended").onEnter([]() {
+			printf("Vitus er sej \n");
+			io.send("oled 5 \"mission 1 ended.\"");
+		}).isFinal();
+	}
+	bool finished = machine1.tick(state);
+	if (finished and state != 999)
+	{ // unknown state
 		printf("Laura is cool \n");
-		bridge->send("oled 5 \"mission 1 ended.\"");
-		finished = true;
-		break;
-		
+		io.send("oled 5 \"mission 1 ended.\"");
 	}
 	return finished;
 }
@@ -1239,6 +1440,8 @@ void UMission::openLog()
     fprintf(logMission, "%% 1  Time [sec]\n");
     fprintf(logMission, "%% 2  mission number.\n");
     fprintf(logMission, "%% 3  mission state.\n");
+    fprintf(logMission, "%% '%% timing' lines are vision and capture stage times [ms]\n");
+    snippetTrace.setLog(logMission);
   }
   else
     printf("#UCamera:: Failed to open image logfile\n");
@@ -1248,6 +1451,10 @@ void UMission::closeLog()
 {
   if (logMission != NULL)
   {
+    machine1.logStats(logMission);
+    UTiming::logStats(logMission);
+    UPerfCount::logAll(logMission);
+    snippetTrace.setLog(NULL);
     fclose(logMission);
     logMission = NULL;
   }
@@ -4,6 +4,17 @@
 #include "umission.h"
 #include "utime.h"
 #include "ulibpose2pose.h"
+#include "umissionio.h"
+#include "utiming.h"
+#include "uperfcount.h"
+#include "usnippettrace.h"
+#include "usnippetlink.h"
+#include "usnippetopt.h"
+#include "umetrics.h"
+#include "utracer.h"
+#include "uvision.h"
+#include "ulandmark.h"
+#include "umissiontask.h"
 #include <iostream>
 #include <math.h>
 #include <opencv2/opencv.hpp>
@@ -12,101 +23,136 @@
 using namespace std;
 using namespace cv;
 
+/// bridge and camera access for the mission (can record and replay)
+static UMissionIO io;
 
-//////////////////// START PERSONAL FUNCTIONS //////////////////
+/// hardware counters for snippet formatting and upload
+static UPerfCount snippetPerf("snippet");
 
-//function that detects the circles in image
-vector<Vec3f> houghcircles(Mat img){
+/// round trip latency of snippets
+static USnippetTrace snippetTrace;
 
-  Mat detectImgCircles;
-  img.copyTo(detectImgCircles); // imgCircles
+/// snippet upload to the REGBOT threads
+static USnippetLink snippetLink(io);
 
-  Mat gray; //image in gray scale
-  cvtColor(img, gray, COLOR_RGB2GRAY); //imgCircles
+/// removes stops and merges lines before upload, if enabled
+static USnippetOptimiser snippetOpt;
 
-  Mat img_blur;
-  medianBlur(gray, img_blur, 5); //blurr the image to make the calculations more efficient
+/// runtime metrics for the mission loop and snippets
+static UCounter * loopMetric = UMetrics::counter("mission.loops");
+static UGauge * partMetric = UMetrics::gauge("mission.part");
+static UGauge * stateMetric = UMetrics::gauge("mission.state");
+static UCounter * snippetMetric = UMetrics::counter("snippet.sent");
+static UCounter * snippetLineMetric = UMetrics::counter("snippet.lines");
+/// hardware counters for the ArUco analysis (camera thread, so all threads)
+static UPerfCount arucoPerf("aruco", true);
 
-  Mat contrast;
-  img_blur.convertTo(contrast, -1, 2.1, 1); //increase the contrast by 4
+/// landmark detector (trees, doors), loaded in missionInit
+static ULandmarkDetector landmarks;
 
-  
-  vector<Vec3f> circles;
-  HoughCircles(contrast, circles, HOUGH_GRADIENT, 1, img.rows/16, 100, 20, 40, 80);
-
-  return circles;
-
-}
-
-// function that detects x coordinate and radius of the closest circle
-vector<double> closestBallcoord(vector<Vec3f> circles) {
+/// coroutine mission tasks (mission 3 with MISSION_BALL_DEMO), on mission time (replay)
+static UTaskScheduler tasks([]() { return io.now(); }, []() { io.wake(); });
+/// the mission 3 drive is finished, the ball watch can stop
+static bool ballDriveDone = false;
 
-  //Set if ball is detected
-  bool ballDetected = false;
-  ballDetected = !circles.empty();
-
-  int closestCircleDetected = 0;
-
-  // Get radius and outline of circles detected - We are interested in the closest and largest circle
-  if (ballDetected == true)
-  {
-    for (size_t i = 0; i < circles.size(); i++)
+/**
+ * Find the closest ball in a camera image, in another thread
+ * \param still if true a full resolution still image, else a stream frame
+ * \returns awaitable with x pixel coordinate and radius, empty if no ball */
+static UTaskScheduler::UResult<vector<double> > detectBall(bool still)
+{
+  return tasks.async<vector<double> >([still]() {
+    vector<double> ball;
+    Mat img;
+    if (still ? io.captureStill(img) : io.capture(img))
     {
-      Point center(cvRound(circles[i][0]), cvRound(circles[i][1]));
-      // center of the circle
-      double radius = cvRound(circles[i][2]);
-
-      // Check if the circle is the closest
-      if (radius > circles[closestCircleDetected][2])
-      {
-        closestCircleDetected = i;
-      }
+      vector<Vec3f> circles = houghcircles(img);
+      if (not circles.empty())
+        ball = closestBallcoord(circles);
     }
-  }
-  vector<double> params;
-  params.push_back(circles[closestCircleDetected][0]); // x pixel coordinate
-  params.push_back(circles[closestCircleDetected][2]); // radius
-
-  return params;
+    return ball;
+  });
 }
 
-
-//gives distance to given circle
-double PD2(double radius) {
-
-  //double FL = 3.04;
-  double pixelMM = 1.12 * 1e-3;
-  const double horiResMM = pixelMM* 3280;
-  const double FOVdegHalf = 31.1;
-  double FOVrad = FOVdegHalf * CV_PI / 180;
-  double FocalLength = horiResMM / (2 * tan(FOVrad));
-  double diameterDetectedBall = radius / 2;
-  //double diameterDetectedBall = radius*2;
-  diameterDetectedBall *= pixelMM;
-  double distance = (FocalLength * horiResMM) / diameterDetectedBall;
-  //double distance2Ball = (distance * pixelMM) / 10; 
-
-  //return distance2Ball; 
-  return distance;
-
+/**
+ * Wait for REGBOT event n (and clear it), at most timeout [sec]
+ * \returns awaitable giving false on timeout */
+static UTaskScheduler::UUntil event(int n, double timeout = -1)
+{
+  return tasks.until([n]() { return io.isEventSet(n); }, timeout);
 }
 
+/**
+ * Awaitable snippet upload (see sendSnippet), co_await activates the
+ * snippet when the upload is acknowledged, and gives false if the
+ * acknowledge timed out (activated anyway, as sendAndActivateSnippet) */
+class USendSnippet
+{
+public:
+  /// wait for the upload acknowledge
+  UTaskScheduler::UUntil ack;
+  /// active REGBOT thread of the mission, set to the new one
+  int * threadActive;
+  /// thread with the new snippet
+  int thread;
+  /// time of upload
+  double sent;
+  bool await_ready() { return ack.await_ready(); }
+  void await_suspend(std::coroutine_handle<> h) { ack.await_suspend(h); }
+  bool await_resume()
+  {
+    bool ok = snippetLink.ackResult(ack.await_resume(), sent);
+    if (not ok)
+      printf("# sendSnippet: no acknowledge (event %d), activating anyway\n",
+             USnippetLink::ACK_EVENT);
+    snippetLink.activate(thread == 100 ? 30 : 31);
+    snippetTrace.activated(io.now());
+    *threadActive = thread;
+    return ok;
+  }
+};
 
-//Used to know how much the robot has to rotate
-double angle2point(int x_coord_point) {
-  const double horizontalResolution = 3280;
-  const double widthFromMid = horizontalResolution / 2;
-  const double horizontalFOV = 62.2;
-  const double hFOVmiddle = horizontalFOV / 2;
-  double displacementRatio = double(x_coord_point) / widthFromMid;
-  double pointAngleHorizontal = (displacementRatio - 1) * hFOVmiddle;
-  return pointAngleHorizontal;
+/**
+ * Upload snippet lines to the inactive REGBOT thread, as sendAndActivateSnippet,
+ * but for a mission task: the task waits for the acknowledge (event 29)
+ * in the scheduler, so the other tasks run meanwhile.
+ *   co_await sendSnippet(m->threadActive, m->mission, m->missionState, m->lines, line, MAX_LEN);
+ * \param threadActive is the active thread (100 or 101), changed at activation
+ * \param maxLen is the line buffer size */
+static USendSnippet sendSnippet(int & threadActive, int mission, int state,
+                                char ** lines, int lineCnt, int maxLen)
+{
+  int thread = threadActive == 101 ? 100 : 101;
+  // optional peephole optimising (MISSION_SNIPPET_OPT)
+  float saved;
+  lineCnt = snippetOpt.optimise(lines, lineCnt, maxLen, saved);
+  snippetTrace.begin(mission, state, lines, lineCnt, io.now());
+  int n = snippetLink.upload(thread, lines, lineCnt);
+  snippetLineMetric->add(n);
+  snippetTrace.sent(io.now());
+  snippetMetric->add();
+  double sent = io.now();
+  return USendSnippet{event(USnippetLink::ACK_EVENT, 0.1), &threadActive, thread, sent};
 }
 
+/// time [sec] the last ArUco mission snippet was sent
+static double arucoSnippetTime = 0;
 
-//////////////////// END PERSONAL FUNCTIONS //////////////////
-
-
+/**
+ * Take queued events until event n is found.
+ * The queue is cleared when a snippet is sent, so event 2 (used by every
+ * snippet in arucoSubmission) is from this snippet, not an earlier one.
+ * \param since is the time the snippet that sends the event was sent
+ * \returns true if event n is received */
+static bool eventReceived(int n, double since)
+{
+  UMissionIO::UEventItem e;
+  if (not io.takeEvent(n, e))
+    return false;
+  printf("# event %d after %.3f sec (used %.1f ms after poll)\n",
+         n, e.host - since, (io.now() - e.host) * 1000);
+  return true;
+}
 
 
 /////////////////////  START UMISSION INITIALIZATION FUNCTIONS //////////////
@@ -117,6 +163,12 @@ UMission::UMission(UBridge * regbot, UCamera * camera)
 {
   cam = camera;
   bridge = regbot;
+  // all mission I/O through io, so it can be recorded or replayed
+  io.setup(regbot, camera);
+  // completion events for snippet tracing
+  io.setEventHook([](int n, bool isSet) { snippetTrace.event(n, isSet, io.now()); });
+  // live metrics in a file and on 127.0.0.1:24010
+  UMetrics::start("mission_metrics.txt", 24010);
   threadActive = 100;
   // initialize line list to empty
   for (int i = 0; i < missionLineMax; i++)
@@ -134,6 +186,9 @@ UMission::UMission(UBridge * regbot, UCamera * camera)
 
 UMission::~UMission()
 {
+  UMetrics::stop();
+  UTracer::stop();
+  io.close();
   printf("Mission class destructor\n");
 }
 
@@ -153,6 +208,14 @@ void UMission::printStatus()
   printf("# ------- Mission ----------\n");
   printf("# active = %d, finished = %d\n", active, finished);
   printf("# mission part=%d, in state=%d\n", mission, missionState);
+  landmarks.printStatus();
+  tasks.printStatus();
+  if (snippetOpt.enabled)
+    printf("# snippet optimiser: %d lines removed, predicted %.1f sec saved\n",
+           snippetOpt.linesRemoved, snippetOpt.totalSaved);
+  UTiming::printStatus();
+  UPerfCount::printAll();
+  snippetTrace.printStatus();
 }
   
 /**
@@ -161,9 +224,10 @@ void UMission::printStatus()
  * in the REGBOT microprocessor. */
 void UMission::missionInit()
 { // stop any not-finished mission
-  bridge->send("robot stop\n");
+  io.send("robot stop\n");
   // clear old mission
-  bridge->send("robot <clear\n");
+  io.send("robot <clear\n");
+  snippetLink.clear();
   //
   // add new mission with 3 threads
   // one (100) starting at event 30 and stopping at event 31
@@ -171,48 +235,48 @@ void UMission::missionInit()
   // one (  1) used for idle and initialisation of hardware
   // the mission is started, but staying in place (velocity=0, so servo action)
   //
-  bridge->send("robot <add thread=1\n");
+  io.send("robot <add thread=1\n");
   // Irsensor should be activated a good time before use 
   // otherwise first samples will produce "false" positive (too short/negative).
-  bridge->send("robot <add irsensor=1,vel=0:dist<0.2\n");
+  io.send("robot <add irsensor=1,vel=0:dist<0.2\n");
   //
   // alternating threads (100 and 101, alternating on event 30 and 31 (last 2 events)
-  bridge->send("robot <add thread=100,event=30 : event=31\n");
+  io.send("robot <add thread=100,event=30 : event=31\n");
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
     // are to be replaced with real mission
     // NB - hereafter no lines can be added to these threads, just modified
-    bridge->send("robot <add vel=0 : time=0.1\n");
+    io.send("robot <add vel=0 : time=0.1\n");
   //
-  bridge->send("robot <add thread=101,event=31 : event=30\n");
+  io.send("robot <add thread=101,event=31 : event=30\n");
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
-    bridge->send("robot <add vel=0 : time=0.1\n");
-  usleep(10000);
+    io.send("robot <add vel=0 : time=0.1\n");
+  io.sleep(10000);
   //
   //
   // send subscribe to bridge
-  bridge->pose->subscribe();
-  bridge->edge->subscribe();
-  bridge->motor->subscribe();
-  bridge->event->subscribe();
-  bridge->joy->subscribe();
-  bridge->motor->subscribe();
-  bridge->info->subscribe();
-  bridge->irdist->subscribe();
-  bridge->imu->subscribe();
-  usleep(10000);
+  io.subscribe();
+  io.sleep(10000);
   // there maybe leftover events from last mission
-  bridge->event->clearEvents();
+  io.clearEvents();
+  // landmark detector - a small int8 network if available, else cascades
+  if (not landmarks.isLoaded())
+  {
+    if (not landmarks.loadDnn("landmarks_int8.onnx", "landmarks.txt", true))
+    {
+      landmarks.loadCascade("tree", "cascade_tree.xml");
+      landmarks.loadCascade("siemens", "cascade_siemens.xml");
+    }
+  }
 }
 
 
 void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
 {
+  UPerfScope perf(snippetPerf);
   // Calling sendAndActivateSnippet automatically toggles between thread 100 and 101. 
   // Modifies the currently inactive thread and then makes it active. 
-  const int MSL = 100;
-  char s[MSL];
   int threadToMod = 101;
   int startEvent = 31;
   // select Regbot thread to modify
@@ -231,23 +295,22 @@ void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
     printf("# -----------------------------------------------\n");
     missionLineCnt = missionLineMax;
   }
-  // send mission lines using '<mod ...' command
-  for (int i = 0; i < missionLineCnt; i++)
-  { // send lines one at a time
-    if (strlen((char*)missionLines[i]) > 0)
-    { // send a modify line command
-      snprintf(s, MSL, "<mod %d %d %s\n", threadToMod, i+1, missionLines[i]);
-      bridge->send(s); 
-    }
-    else
-      // an empty line will end code snippet too
-      break;
-  }
-  // let it sink in (10ms)
-  usleep(10000);
+  // optional peephole optimising (MISSION_SNIPPET_OPT)
+  float saved;
+  missionLineCnt = snippetOpt.optimise(missionLines, missionLineCnt, MAX_LEN, saved);
+  if (saved > 0)
+    printf("# snippet optimised, predicted %.2f sec saved\n", saved);
+  snippetTrace.begin(mission, missionState, missionLines, missionLineCnt, io.now());
+  // send mission lines using '<mod ...' commands, all in one message
+  int n = snippetLink.upload(threadToMod, missionLines, missionLineCnt);
+  snippetLineMetric->add(n);
+  snippetTrace.sent(io.now());
+  snippetMetric->add();
+  // wait until the REGBOT has all lines (acknowledge event)
+  snippetLink.waitAck();
   // Activate new snippet thread and stop the other  
-  snprintf(s, MSL, "<event=%d\n", startEvent);
-  bridge->send(s);
+  snippetLink.activate(startEvent);
+  snippetTrace.activated(io.now());
   // save active thread number
   threadActive = threadToMod;
 }
@@ -289,25 +352,26 @@ void UMission::runMission()
   // fixed string buffer
   const int MSL = 120;
   char s[MSL];
+  UTracer::threadName("mission");
   /// initialize robot mission to do nothing (wait for mission lines)
   missionInit();
   /// start (the empty) mission, ready for mission snippets.
-  bridge->send("start\n"); // ask REGBOT to start controlled run (ready to execute)
-  bridge->send("oled 3 waiting for REGBOT\n");
+  io.send("start\n"); // ask REGBOT to start controlled run (ready to execute)
+  io.send("oled 3 waiting for REGBOT\n");
 //   play.say("Waiting for robot data.", 100);
   ///
   for (int i = 0; i < 3; i++)
   {
-    if (not bridge->info->isHeartbeatOK())
+    if (not io.isHeartbeatOK())
     { // heartbeat should come at least once a second
-      sleep(2);
+      io.sleep(2000000);
     }
   }
-  if (not bridge->info->isHeartbeatOK())
+  if (not io.isHeartbeatOK())
   { // heartbeat should come at least once a second
     play.say("Oops, no usable connection with robot.", 100);
 //    system("espeak \"Oops, no usable connection with robot.\" -ven+f4 -s130 -a60 2>/dev/null &"); 
-    bridge->send("oled 3 Oops: Lost REGBOT!");
+    io.send("oled 3 Oops: Lost REGBOT!");
     printf("# ---------- error ------------\n");
     printf("# No heartbeat from robot. Bridge or REGBOT is stuck\n");
 //     printf("# You could try restart ROBOBOT bridge ('b' from mission console) \n");
@@ -317,28 +381,33 @@ void UMission::runMission()
       // for debug - allow this
       stop();
   }
+  UTracer::missionState(mission, missionState);
   /// loop in sequence every mission until they report ended
   while (not finished and not th1stop)
   { // stay in this mission loop until finished
     loop++;
+    loopMetric->add();
+    if (snippetTrace.waitingForMotion())
+      // first motion of the latest snippet
+      snippetTrace.velocity(io.velocity(), io.now());
     // test for manuel override (joy is short for joystick or gamepad)
-    if (bridge->joy->manual)
+    if (io.joyManual())
     { // just wait, do not continue mission
-      usleep(20000);
+      io.sleep(20000);
       if (not inManual)
       {
 //         system("espeak \"Mission paused.\" -ven+f4 -s130 -a40 2>/dev/null &"); 
         play.say("Mission paused.", 90);
       }
       inManual = true;
-      bridge->send("oled 3 GAMEPAD control\n");
+      io.send("oled 3 GAMEPAD control\n");
     }
     else
     { // in auto mode
       if (not regbotStarted)
       { // wait for start event is received from REGBOT
         // - in response to 'bot->send("start\n")' earlier
-        if (bridge->event->isEventSet(33))
+        if (io.isEventSet(33))
         { // start mission (button pressed)
 //           printf("Mission::runMission: starting mission (part from %d to %d)\n", fromMission, toMission);
           regbotStarted = true;
@@ -351,7 +420,7 @@ void UMission::runMission()
           inManual = false;
 //           system("espeak \"Mission resuming.\" -ven+f4 -s130 -a40 2>/dev/null &");
           play.say("Mission resuming", 90);
-          bridge->send("oled 3 running AUTO\n");
+          io.send("oled 3 running AUTO\n");
 
         } /////////////////////HERE WE INSERT MISSIONS//////////////////////
 
@@ -360,13 +429,13 @@ void UMission::runMission()
           case 1: // running auto mission
             ended = mission1(missionState);
             break;
+          case 3: // ball demo with mission tasks (MISSION_BALL_DEMO)
+            ended = mission3(missionState);
+            break;
             /*
           case 2:
             ended = mission2(missionState);
             break;
-          case 3:
-            ended = mission3(missionState);
-            break;
           case 4:
             ended = mission4(missionState);
             break;*/
@@ -387,7 +456,10 @@ void UMission::runMission()
           UTime t;
           t.now();
           snprintf(s, MSL, "oled 4 mission %d state %d\n", mission, missionState);
-          bridge->send(s);
+          partMetric->set(mission);
+          stateMetric->set(missionState);
+          UTracer::missionState(mission, missionState);
+          io.send(s);
           if (logMission != NULL)
           {
             fprintf(logMission, "%ld.%03ld %d %d\n", 
@@ -398,6 +470,11 @@ void UMission::runMission()
                     t.getSec(), t.getMilisec(),
                     mission, missionState
             );
+            if (mission != missionOld)
+            { // stage timing for the finished mission part
+              UTiming::logStats(logMission);
+              UPerfCount::logAll(logMission);
+            }
           }
           missionOld = mission;
           missionStateOld = missionState;
@@ -413,7 +490,7 @@ void UMission::runMission()
     // gamepad buttons 0=green, 1=red, 2=blue, 3=yellow, 4=LB, 5=RB, 6=back, 7=start, 8=Logitech, 9=A1, 10 = A2
     // gamepad axes    0=left-LR, 1=left-UD, 2=LT, 3=right-LR, 4=right-UD, 5=RT, 6=+LR, 7=+-UD
     // see also "ujoy.h"
-    if (bridge->joy->button[BUTTON_RED])
+    if (io.joyButton(BUTTON_RED))
     { // red button -> save image
       if (not cam->saveImage)
       {
@@ -421,7 +498,7 @@ void UMission::runMission()
         cam->saveImage = true;
       }
     }
-    if (bridge->joy->button[BUTTON_YELLOW])
+    if (io.joyButton(BUTTON_YELLOW))
     { // yellow button -> make ArUco analysis
       if (not cam->doArUcoAnalysis)
       {
@@ -430,7 +507,7 @@ void UMission::runMission()
       }
     }
     // are we finished - event 0 disables motors (e.g. green button)
-    if (bridge->event->isEventSet(0))
+    if (io.isEventSet(0))
     { // robot say stop
       finished = true;
       printf("Mission:: insist we are finished\n");
@@ -438,19 +515,21 @@ void UMission::runMission()
     else if (mission > toMission)
     { // stop robot
       // make an event 0
-      bridge->send("stop\n");
+      io.send("stop\n");
       // stop mission loop
       finished = true;
     }
-    // release CPU a bit (10ms)
-    usleep(10000);
+    // release CPU until the next REGBOT event (at most 10ms)
+    io.waitNewEvent(10000);
   }
-  bridge->send("stop\n");
-  snprintf(s, MSL, "Robot %s finished.\n", bridge->info->robotname);
+  io.send("stop\n");
+  snprintf(s, MSL, "Robot %s finished.\n", io.robotName());
 //   system(s); 
   play.say(s, 100);
   printf("%s", s);
-  bridge->send("oled 3 finished\n");
+  io.send("oled 3 finished\n");
+  // finish recording (if any)
+  io.close();
 }
 
 
@@ -473,10 +552,10 @@ bool UMission::mission1(int & state)
 
     case 0: //go to the first tree
     {
-      system("libcamera-still -r -o img1.jpg");
       //Mat initial;
       //cam->capture(initial);
-      Mat initial = imread("img1.jpg"); // initial image robot takes 
+      Mat initial; // initial image robot takes 
+      io.captureStill(initial);
       vector<Vec3f> circles= houghcircles(initial);
       vector<double> params= closestBallcoord(circles); // xpix_closest, radius;
       
@@ -493,10 +572,12 @@ bool UMission::mission1(int & state)
       snprintf(lines[2], MAX_LEN, "event=1"); // funcio distancia
 
       // send the 2 lines to the REGBOT
+      // (an old event 1 would end the wait below while still driving)
+      io.clearEvent(1);
       sendAndActivateSnippet(lines, 3);
-      usleep(10000000);
-      // make sure event 1 is set in mission
-      bridge->event->isEventSet(1);
+      // wait for the drive to finish (event 1)
+      if (not io.waitForEvent(1, 10.0))
+        printf("# mission1: no event 1 in 10 sec, continues\n");
 
       state =3;
       // state = 999; //used to finish and just test this first part
@@ -514,10 +595,35 @@ bool UMission::mission1(int & state)
     }
 
     case 4:
-    // turn and go to siemens (hard code) : open door
+    { // turn and go to siemens : open door
+      // turn towards the door if the landmark detector can see it
+      vector<ULandmark> found;
+      if (landmarks.isLoaded())
+      {
+        Mat img;
+        if (io.captureStill(img))
+          landmarks.detect(img, found);
+      }
+      const ULandmark * door = ULandmarkDetector::find(found, "siemens");
+      if (door != NULL)
+      {
+        printf("# found siemens door at %.1f deg (confidence %.2f)\n", door->bearing, door->confidence);
+        snprintf(lines[0], MAX_LEN, "vel=0.5, tr=0.1 :turn=%.1f", door->bearing);
+        snprintf(lines[1], MAX_LEN, "event=1");
+        // make sure an old event 1 is cleared before the turn starts
+        io.clearEvent(1);
+        sendAndActivateSnippet(lines, 2);
+        state = 41;
+      }
+      else
+        state =5;
+      break;
+    }
 
-    state =5;
-    break;
+    case 41: // wait for the turn towards the door to finish
+      if (io.isEventSet(1))
+        state = 5;
+      break;
     
 
     case 5:
@@ -525,7 +631,7 @@ bool UMission::mission1(int & state)
     case 999:
     default:
       printf("mission 1 ended \n");
-      bridge->send("oled 5 \"mission 1 ended.\"");
+      io.send("oled 5 \"mission 1 ended.\"");
       finished = true;
       break;
   }
@@ -544,25 +650,29 @@ bool UMission::arucoSubmission(int & state)
       printf("# started mission 2.\n");
 //       system("espeak \"looking for ArUco\" -ven+f4 -s130 -a5 2>/dev/null &"); 
       play.say("Looking for ArUco.", 90);
-      bridge->send("oled 5 looking 4 ArUco");
+      io.send("oled 5 looking 4 ArUco");
+      // events taken in order by eventReceived
+      io.enableEventQueue(true);
       state=11;
       break;
     case 11:
       // wait for finished driving first part)
-      if (fabsf(bridge->motor->getVelocity()) < 0.001 and bridge->imu->turnrate() < (2*180/M_PI))
+      if (fabsf(io.velocity()) < 0.001 and io.turnrate() < (2*180/M_PI))
       { // finished first drive and turnrate is zero'ish
         state = 12;
         // wait further 30ms - about one camera frame at 30 FPS
-        usleep(35000);
+        io.sleep(35000);
         // start aruco analysis 
         printf("# started new ArUco analysis\n");
         cam->arUcos->setNewFlagToFalse();
+        arucoPerf.start();
         cam->doArUcoAnalysis = true;
       }
       break;
     case 12:
       if (not cam->doArUcoAnalysis)
       { // aruco processing finished
+        arucoPerf.stop();
         if (cam->arUcos->getMarkerCount(true) > 0)
         { // found a marker - go to marker (any marker)
           state = 30;
@@ -570,7 +680,7 @@ bool UMission::arucoSubmission(int & state)
           printf("# case=%d found marker\n", state);
 //           system("espeak \"found marker.\" -ven+f4 -s130 -a5 2>/dev/null &"); 
           play.say("Found ArUco marker.", 90);
-          bridge->send("oled 5 found marker");
+          io.send("oled 5 found marker");
         }
         else
         { // turn a bit (more)
@@ -583,18 +693,19 @@ bool UMission::arucoSubmission(int & state)
         int line = 0;
         snprintf(lines[line++], MAX_LEN, "vel=0.25, tr=0.15: turn=10,time=10");
         snprintf(lines[line++], MAX_LEN, "vel=0,event=2:dist=1");
+        // events from before the snippet are not used
+        io.clearEventQueue();
+        arucoSnippetTime = io.now();
         sendAndActivateSnippet(lines, line);
-        // make sure event 2 is cleared
-        bridge->event->isEventSet(2);
         // tell the operator
         printf("# case=%d sent mission turn a bit\n", state);
         system("espeak \"turn.\" -ven+f4 -s130 -a5 2>/dev/null &"); 
-        bridge->send("oled 5 code turn a bit");
+        io.send("oled 5 code turn a bit");
         state = 21;
         break;
       }
     case 21: // wait until manoeuvre has finished
-      if (bridge->event->isEventSet(2))
+      if (eventReceived(2, arucoSnippetTime))
       {// repeat looking (until all 360 degrees are tested)
         if (featureCnt < 36)
           state = 11;
@@ -657,9 +768,10 @@ bool UMission::arucoSubmission(int & state)
                      sqrt(2*pp4.finalBreak));
           }
           snprintf(lines[line++], MAX_LEN,   "vel=0, event=2: dist=1");
+          // events from before the snippet are not used
+          io.clearEventQueue();
+          arucoSnippetTime = io.now();
           sendAndActivateSnippet(lines, line);
-          // make sure event 2 is cleared
-          bridge->event->isEventSet(2);
           //
           // debug
           for (int i = 0; i < line; i++)
@@ -670,7 +782,7 @@ bool UMission::arucoSubmission(int & state)
           // tell the operator
           printf("# Sent mission snippet to marker (%d lines)\n", line);
           //system("espeak \"code snippet to marker.\" -ven+f4 -s130 -a20 2>/dev/null &"); 
-          bridge->send("oled 5 code to marker");
+          io.send("oled 5 code to marker");
           // wait for movement to finish
           state = 31;
         }
@@ -686,7 +798,7 @@ bool UMission::arucoSubmission(int & state)
       break;
     case 31:
       // wait for event 2 (send when finished driving)
-      if (bridge->event->isEventSet(2))
+      if (eventReceived(2, arucoSnippetTime))
       { // look for next marker
         state = 11;
         // no, stop
@@ -696,7 +808,8 @@ bool UMission::arucoSubmission(int & state)
     case 999:
     default:
       printf("mission 1 ended \n");
-      bridge->send("oled 5 \"mission 1 ended.\"");
+      io.send("oled 5 \"mission 1 ended.\"");
+      io.enableEventQueue(false);
       finished = true;
       play.stopPlaying();
       break;
@@ -900,10 +1013,59 @@ bool UMission::mission3(int & state)
   bool finished = false;
   switch (state)
   {
+    case 0:
+    { // drive to the ball, while a second task keeps looking at it
+      if (getenv("MISSION_BALL_DEMO") == NULL)
+      { // the robot drives, so only if asked for
+        state = 999;
+        break;
+      }
+      auto drive = [](UMission * m) -> UMissionTask {
+        vector<double> ball = co_await detectBall(true);
+        if (ball.empty())
+        {
+          printf("# mission3: no ball found\n");
+          ballDriveDone = true;
+          co_return;
+        }
+        double angle = angle2point(ball[0]);
+        double distance = PD2(ball[1]);
+        printf("# mission3: ball at %.1f deg, %.2f m\n", angle, distance);
+        int line = 0;
+        snprintf(m->lines[line++], MAX_LEN, "vel=0.5, tr=0.1: turn=%.1f", angle);
+        snprintf(m->lines[line++], MAX_LEN, "vel=0.3, acc=1: dist=%.3f", fmax(0, distance - 0.2));
+        snprintf(m->lines[line++], MAX_LEN, "vel=0, event=3: time=0.1");
+        io.clearEvent(3);
+        co_await sendSnippet(m->threadActive, m->mission, m->missionState, m->lines, line, MAX_LEN);
+        io.send("oled 5 mission 3 to ball");
+        if (not co_await event(3, 20))
+          printf("# mission3: no event 3 in 20 sec\n");
+        ballDriveDone = true;
+      };
+      auto watch = [](UMission *) -> UMissionTask {
+        while (not ballDriveDone)
+        {
+          vector<double> ball = co_await detectBall(false);
+          if (not ball.empty())
+            printf("# mission3 watch: ball at x=%.0f, %.2f m\n", ball[0], PD2(ball[1]));
+          co_await tasks.sleep(0.1);
+        }
+      };
+      ballDriveDone = false;
+      tasks.spawn(drive(this), "ball drive");
+      tasks.spawn(watch(this), "ball watch");
+      state = 1;
+      break;
+    }
+    case 1:
+      // resume the tasks that are ready, until all are finished
+      if (tasks.poll() == 0)
+        state = 999;
+      break;
     case 999:
     default:
       printf("mission 3 ended\n");
-      bridge->send("oled 5 mission 3 ended.");
+      io.send("oled 5 mission 3 ended.");
       finished = true;
       break;
   }
@@ -925,7 +1087,7 @@ bool UMission::mission4(int & state)
     case 999:
     default:
       printf("mission 4 ended\n");
-      bridge->send("oled 5 mission 4 ended.");
+      io.send("oled 5 mission 4 ended.");
       finished = true;
       break;
   }
@@ -955,6 +1117,8 @@ void UMission::openLog()
     fprintf(logMission, "%% 1  Time [sec]\n");
     fprintf(logMission, "%% 2  mission number.\n");
     fprintf(logMission, "%% 3  mission state.\n");
+    fprintf(logMission, "%% '%% timing' lines are vision and capture stage times [ms]\n");
+    snippetTrace.setLog(logMission);
   }
   else
     printf("#UCamera:: Failed to open image logfile\n");
@@ -964,6 +1128,9 @@ void UMission::closeLog()
 {
   if (logMission != NULL)
   {
+    UTiming::logStats(logMission);
+    UPerfCount::logAll(logMission);
+    snippetTrace.setLog(NULL);
     fclose(logMission);
     logMission = NULL;
   }
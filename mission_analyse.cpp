@@ -0,0 +1,371 @@
+/**
+ * Post-run analysis of mission logs (log_mission_*.txt written by openLog()).
+ * Computes the time spent in each mission state for every run, and the mean
+ * and variation over a set of runs. With two run sets (before and after a
+ * parameter change) the states that got slower or faster are highlighted.
+ * If the logs have '% snippet' lines (snippet tracing), the mean snippet
+ * latencies per state are shown too.
+ *
+ * build:
+ *   g++ -O2 -std=c++17 -o mission_analyse mission_analyse.cpp
+ * use:
+ *   mission_analyse log_mission_*.txt                          (one set)
+ *   mission_analyse -a 'before/log_mission_*.txt' -b 'after/log_mission_*.txt'
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <glob.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+/// mission and state
+typedef pair<int, int> UStateKey;
+
+/**
+ * Snippet latencies for a state, summed [ms] */
+class USnippetSum
+{
+public:
+  int n = 0;
+  int motionCnt = 0;
+  /// completed snippets (with a run time)
+  int runCnt = 0;
+  /// snippets replaced before their completion event
+  int replaced = 0;
+  double upload = 0;
+  double motion = 0;
+  double run = 0;
+};
+
+/**
+ * One mission run (one log file) */
+class URun
+{
+public:
+  string name;
+  /// time in each state [sec], summed if the state is visited more than once
+  map<UStateKey, double> stateTime;
+  /// state order of first visit
+  vector<UStateKey> order;
+  map<UStateKey, USnippetSum> snippets;
+  double total = 0;
+};
+
+/**
+ * State time statistics over a set of runs */
+class UStateStat
+{
+public:
+  int n = 0;
+  double mean = 0;
+  double sd = 0;
+  double min = 0;
+  double max = 0;
+  USnippetSum snippet;
+};
+
+
+/**
+ * Read one log file
+ * \returns false if no states found */
+static bool readRun(const char * name, URun & run)
+{
+  FILE * f = fopen(name, "r");
+  if (f == NULL)
+  {
+    printf("# failed to open '%s'\n", name);
+    return false;
+  }
+  run.name = name;
+  const int MSL = 500;
+  char s[MSL];
+  bool started = false;
+  UStateKey current;
+  double tStart = 0, tFirst = 0, tLast = 0;
+  while (fgets(s, MSL, f) != NULL)
+  {
+    if (s[0] == '%')
+    { // '% snippet <id> mission <m> state <s> ... upload <ms> activate <ms> motion <ms> run <ms> ...'
+      int id, m, st;
+      if (sscanf(s, "%% snippet %d mission %d state %d", &id, &m, &st) == 3)
+      {
+        USnippetSum & sn = run.snippets[make_pair(m, st)];
+        const char * p;
+        sn.n++;
+        if ((p = strstr(s, " upload ")) != NULL)
+          sn.upload += fmax(0, strtod(p + 8, NULL));
+        if ((p = strstr(s, " motion ")) != NULL and strtod(p + 8, NULL) >= 0)
+        {
+          sn.motion += strtod(p + 8, NULL);
+          sn.motionCnt++;
+        }
+        if ((p = strstr(s, " run ")) != NULL and strtod(p + 5, NULL) >= 0)
+        {
+          sn.run += strtod(p + 5, NULL);
+          sn.runCnt++;
+        }
+        else
+          sn.replaced++;
+      }
+      continue;
+    }
+    double t;
+    int m, st;
+    if (sscanf(s, "%lf %d %d", &t, &m, &st) != 3)
+      continue;
+    UStateKey key(m, st);
+    if (not started)
+    {
+      started = true;
+      current = key;
+      tStart = tFirst = t;
+    }
+    else if (key != current)
+    { // a change is logged as old state then new state, same time
+      if (run.stateTime.count(current) == 0)
+        run.order.push_back(current);
+      run.stateTime[current] += t - tStart;
+      current = key;
+      tStart = t;
+    }
+    tLast = t;
+  }
+  fclose(f);
+  if (started and run.stateTime.count(current) == 0)
+    // last state, no end time
+    run.order.push_back(current);
+  run.total = tLast - tFirst;
+  return started;
+}
+
+/**
+ * Expand file names and patterns, and read the runs */
+static void readRuns(vector<string> & patterns, vector<URun> & runs)
+{
+  for (string & pat : patterns)
+  {
+    glob_t g;
+    if (glob(pat.c_str(), 0, NULL, &g) != 0)
+    {
+      printf("# no files match '%s'\n", pat.c_str());
+      continue;
+    }
+    for (size_t i = 0; i < g.gl_pathc; i++)
+    {
+      URun run;
+      if (readRun(g.gl_pathv[i], run))
+        runs.push_back(run);
+    }
+    globfree(&g);
+  }
+}
+
+/**
+ * Statistics for each state over a set of runs,
+ * and the states in order of first visit */
+static void statistics(vector<URun> & runs, map<UStateKey, UStateStat> & stats,
+                       vector<UStateKey> & order)
+{
+  map<UStateKey, vector<double> > times;
+  for (URun & run : runs)
+  {
+    for (UStateKey & key : run.order)
+    {
+      if (times.count(key) == 0)
+        order.push_back(key);
+      if (run.stateTime.count(key) > 0)
+        times[key].push_back(run.stateTime[key]);
+      else
+        times[key];
+    }
+    for (auto & sn : run.snippets)
+    {
+      USnippetSum & sum = stats[sn.first].snippet;
+      sum.n += sn.second.n;
+      sum.motionCnt += sn.second.motionCnt;
+      sum.runCnt += sn.second.runCnt;
+      sum.replaced += sn.second.replaced;
+      sum.upload += sn.second.upload;
+      sum.motion += sn.second.motion;
+      sum.run += sn.second.run;
+    }
+  }
+  for (auto & tv : times)
+  {
+    UStateStat & st = stats[tv.first];
+    vector<double> & v = tv.second;
+    st.n = v.size();
+    if (st.n == 0)
+      continue;
+    double sum = 0;
+    st.min = st.max = v[0];
+    for (double t : v)
+    {
+      sum += t;
+      st.min = fmin(st.min, t);
+      st.max = fmax(st.max, t);
+    }
+    st.mean = sum / st.n;
+    double sq = 0;
+    for (double t : v)
+      sq += (t - st.mean) * (t - st.mean);
+    st.sd = st.n > 1 ? sqrt(sq / (st.n - 1)) : 0;
+  }
+}
+
+static void printSnippet(USnippetSum & sn)
+{
+  if (sn.n > 0)
+    printf("  %7.1f %7.1f %8.1f %8d", sn.upload / sn.n,
+           sn.motionCnt > 0 ? sn.motion / sn.motionCnt : -1,
+           sn.runCnt > 0 ? sn.run / sn.runCnt : -1, sn.replaced);
+}
+
+static double meanTotal(vector<URun> & runs)
+{
+  double sum = 0;
+  for (URun & r : runs)
+    sum += r.total;
+  return runs.empty() ? 0 : sum / runs.size();
+}
+
+
+//////////////////// MAIN //////////////////
+
+static void printHelp(const char * name)
+{
+  printf("Usage: %s [options] [log files]\n", name);
+  printf("  -a pattern  log files of run set A (before), may be repeated\n");
+  printf("  -b pattern  log files of run set B (after), may be repeated\n");
+  printf("  -t percent  change of mean needed to flag a state (default 5)\n");
+  printf("  -s sigma    significance needed to flag a state, Welch t (default 2)\n");
+  printf("  -r          also list the runs\n");
+  printf("Log files given without option are in set A.\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+  vector<string> patA, patB;
+  double tolerance = 0.05;
+  double sigma = 2;
+  bool listRuns = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:b:t:s:rh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'a': patA.push_back(optarg); break;
+      case 'b': patB.push_back(optarg); break;
+      case 't': tolerance = atof(optarg) / 100; break;
+      case 's': sigma = atof(optarg); break;
+      case 'r': listRuns = true; break;
+      default:
+        printHelp(argv[0]);
+        return 0;
+    }
+  }
+  for (int i = optind; i < argc; i++)
+    patA.push_back(argv[i]);
+  vector<URun> runsA, runsB;
+  readRuns(patA, runsA);
+  readRuns(patB, runsB);
+  if (runsA.empty())
+  {
+    printHelp(argv[0]);
+    return 1;
+  }
+  if (listRuns)
+  {
+    for (URun & r : runsA)
+      printf("# A %-40s %7.2f sec, %d states\n", r.name.c_str(), r.total, int(r.order.size()));
+    for (URun & r : runsB)
+      printf("# B %-40s %7.2f sec, %d states\n", r.name.c_str(), r.total, int(r.order.size()));
+  }
+  map<UStateKey, UStateStat> statA, statB;
+  vector<UStateKey> order, orderB;
+  statistics(runsA, statA, order);
+  statistics(runsB, statB, orderB);
+  for (UStateKey & key : orderB)
+  { // states only in set B last
+    if (statA.count(key) == 0)
+      order.push_back(key);
+  }
+  bool hasSnippets = false;
+  for (auto & st : statA)
+    hasSnippets |= st.second.snippet.n > 0;
+  for (auto & st : statB)
+    hasSnippets |= st.second.snippet.n > 0;
+  if (runsB.empty())
+  { // one set: durations and variation
+    printf("# %d runs, mean %.2f sec\n", int(runsA.size()), meanTotal(runsA));
+    printf("# mission state  runs    mean [s]      sd     min     max   cv%%");
+    if (hasSnippets)
+      printf("  upload  motion  run [ms] replaced");
+    printf("\n");
+    for (UStateKey & key : order)
+    {
+      UStateStat & a = statA[key];
+      if (a.n == 0)
+        // last state, no duration
+        continue;
+      printf("%9d %5d %5d %11.3f %7.3f %7.3f %7.3f %5.1f", key.first, key.second, a.n,
+             a.mean, a.sd, a.min, a.max, a.mean > 0 ? a.sd / a.mean * 100 : 0);
+      printSnippet(a.snippet);
+      printf("\n");
+    }
+    return 0;
+  }
+  // two sets: differences
+  printf("# A: %d runs, mean %.2f sec;  B: %d runs, mean %.2f sec;  change %+.2f sec\n",
+         int(runsA.size()), meanTotal(runsA), int(runsB.size()), meanTotal(runsB),
+         meanTotal(runsB) - meanTotal(runsA));
+  printf("# mission state   nA  mean A [s]    sd A   nB  mean B [s]    sd B   diff [s]   diff%%      t");
+  if (hasSnippets)
+    printf("  run A [ms] run B [ms]");
+  printf("\n");
+  int slower = 0, faster = 0;
+  for (UStateKey & key : order)
+  {
+    UStateStat & a = statA[key];
+    UStateStat & b = statB[key];
+    if (a.n == 0 and b.n == 0)
+      continue;
+    double diff = b.mean - a.mean;
+    double rel = a.mean > 0 ? diff / a.mean : 0;
+    // Welch t statistic, 0 if too few runs
+    double se = sqrt((a.n > 0 ? a.sd * a.sd / a.n : 0) + (b.n > 0 ? b.sd * b.sd / b.n : 0));
+    double t = se > 0 ? diff / se : 0;
+    const char * flag = "";
+    bool significant = fabs(t) >= sigma or (se == 0 and a.n > 0 and b.n > 0);
+    if (a.n == 0 or b.n == 0)
+      flag = a.n == 0 ? "  new" : "  gone";
+    else if (significant and rel > tolerance)
+    {
+      flag = "  SLOWER";
+      slower++;
+    }
+    else if (significant and rel < -tolerance)
+    {
+      flag = "  faster";
+      faster++;
+    }
+    printf("%9d %5d %4d %11.3f %7.3f %4d %11.3f %7.3f %+10.3f %+6.1f%% %6.1f", key.first, key.second,
+           a.n, a.mean, a.sd, b.n, b.mean, b.sd, diff, rel * 100, t);
+    if (hasSnippets)
+      printf("  %9.1f %9.1f", a.snippet.runCnt > 0 ? a.snippet.run / a.snippet.runCnt : -1,
+             b.snippet.runCnt > 0 ? b.snippet.run / b.snippet.runCnt : -1);
+    printf("%s\n", flag);
+  }
+  printf("# %d states slower, %d faster (change > %.0f%% and |t| >= %.1f)\n",
+         slower, faster, tolerance * 100, sigma);
+  return slower > 0 ? 1 : 0;
+}
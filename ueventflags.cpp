@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#include "ueventflags.h"
+
+using namespace std;
+
+
+void UEventFlags::set(int n)
+{
+  if (n < 0 or n >= MAX_EVENTS)
+  {
+    printf("# UEventFlags::set: no event %d (0..%d)\n", n, MAX_EVENTS - 1);
+    return;
+  }
+  bits.fetch_or(bit(n));
+  setCnt++;
+  { // a waiter between its test and its wait holds the lock, so it can not miss this
+    lock_guard<mutex> guard(lock);
+  }
+  changed.notify_all();
+}
+
+
+bool UEventFlags::test(int n)
+{
+  if (n < 0 or n >= MAX_EVENTS)
+    return false;
+  return (bits.fetch_and(~bit(n)) & bit(n)) != 0;
+}
+
+
+void UEventFlags::clear(int n)
+{
+  if (n >= 0 and n < MAX_EVENTS)
+    bits.fetch_and(~bit(n));
+}
+
+
+bool UEventFlags::waitUntil(function<bool ()> pred, double timeout)
+{
+  unique_lock<mutex> guard(lock);
+  if (timeout < 0)
+  {
+    changed.wait(guard, pred);
+    return true;
+  }
+  return changed.wait_for(guard, chrono::duration<double>(timeout), pred);
+}
+
+
+bool UEventFlags::waitForEvent(int n, double timeout)
+{
+  return waitAny(bit(n), timeout) == n;
+}
+
+
+int UEventFlags::waitAny(uint64_t mask, double timeout)
+{
+  chrono::steady_clock::time_point end = chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(fmax(timeout, 0)));
+  while (true)
+  {
+    uint64_t b = bits & mask;
+    if (b != 0)
+    { // another thread may take it first
+      int n = __builtin_ctzll(b);
+      if (test(n))
+        return n;
+      continue;
+    }
+    double left = timeout;
+    if (timeout >= 0)
+    {
+      chrono::duration<double> dt = end - chrono::steady_clock::now();
+      if (dt.count() <= 0)
+        return -1;
+      left = dt.count();
+    }
+    waitUntil([this, mask]() { return (bits & mask) != 0; }, left);
+  }
+}
+
+
+bool UEventFlags::waitNext(double timeout)
+{
+  unsigned cnt = setCnt;
+  return waitUntil([this, cnt]() { return setCnt != cnt; }, timeout);
+}
+
+
+void UEventFlags::wake()
+{
+  setCnt++;
+  {
+    lock_guard<mutex> guard(lock);
+  }
+  changed.notify_all();
+}
+
+
+void UEventFlags::poll(function<bool (int n)> source, int cnt)
+{
+  for (int n = 0; n < cnt and n < MAX_EVENTS; n++)
+  {
+    if (source(n))
+      set(n);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef UEVENTFLAGS_H
+#define UEVENTFLAGS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * REGBOT event flags as one atomic bitmap.
+ * Setting, testing and clearing a flag is one atomic operation, and a
+ * thread waiting for an event is woken (condition variable) as soon as it
+ * is set, instead of finding it at the next mission loop.
+ *
+ * The bridge event store can only be polled, so it is polled from a
+ * timer (every millisecond) and the flags are moved into the bitmap:
+ *   reactor.addTimer(0.001, 0.001, []() {
+ *     flags.poll([](int n) { return bridge->event->isEventSet(n); }, 34); });
+ *   ...
+ *   if (flags.waitForEvent(2, 10.0))   // wait at most 10 sec for event 2
+ * */
+class UEventFlags
+{
+public:
+  /// events 0..63
+  static const int MAX_EVENTS = 64;
+  static uint64_t bit(int n) { return uint64_t(1) << n; }
+  /** set event flag and wake waiting threads */
+  void set(int n);
+  /** test and clear event flag */
+  bool test(int n);
+  /** test without clearing */
+  bool isSet(int n) { return n >= 0 and n < MAX_EVENTS and (bits & bit(n)) != 0; }
+  /** clear event flag, e.g. an old completion event */
+  void clear(int n);
+  void clearAll() { bits = 0; }
+  /**
+   * Wait for event n, and clear it.
+   * \param timeout is max wait [sec], negative is forever
+   * \returns false on timeout */
+  bool waitForEvent(int n, double timeout);
+  /**
+   * Wait for any of the events in mask (see bit()), and clear it.
+   * \returns the event number (the lowest, if more are set), -1 on timeout */
+  int waitAny(uint64_t mask, double timeout);
+  /**
+   * Wait until an event is set (again) or wake() is called after this call,
+   * without clearing
+   * \returns false on timeout */
+  bool waitNext(double timeout);
+  /** wake threads in waitNext, e.g. on other input */
+  void wake();
+  /**
+   * Set the flags for the events where source(n) is true, n = 0..cnt-1
+   * (called periodically) */
+  void poll(std::function<bool (int n)> source, int cnt);
+
+private:
+  /** wait until pred is true or timeout [sec] (negative is forever) */
+  bool waitUntil(std::function<bool ()> pred, double timeout);
+
+  std::atomic<uint64_t> bits{0};
+  /// number of set() calls, for waitNext()
+  std::atomic<unsigned> setCnt{0};
+  std::mutex lock;
+  std::condition_variable changed;
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "ulandmark.h"
+#include "uvision.h"
+#include "umetrics.h"
+#include "utiming.h"
+
+using namespace std;
+
+/// full resolution width of the camera model in uvision
+static const double cameraModelWidth = 3280;
+
+/// runtime metrics
+static UHistogram * detectMetric = UMetrics::histogram("landmarks.detect_us");
+static UCounter * foundMetric = UMetrics::counter("landmarks.found");
+
+
+bool ULandmarkDnn::load(const char * model, const char * classFile)
+{
+  try
+  { // throws if the file is missing or not a model
+    net = cv::dnn::readNet(model);
+  }
+  catch (const cv::Exception & e)
+  {
+    printf("# ULandmarkDnn::load: failed to load model '%s': %s\n", model, e.what());
+    net = cv::dnn::Net();
+  }
+  if (net.empty())
+  {
+    printf("# ULandmarkDnn::load: failed to load model '%s'\n", model);
+    return false;
+  }
+  // CPU only
+  net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+  net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+  // quantised models are named so
+  int8 = strstr(model, "int8") != NULL or strstr(model, "quant") != NULL;
+  classes.clear();
+  FILE * f = fopen(classFile, "r");
+  if (f != NULL)
+  {
+    const int MSL = 100;
+    char s[MSL];
+    while (fgets(s, MSL, f) != NULL)
+    {
+      s[strcspn(s, "\r\n")] = '\0';
+      if (strlen(s) > 0)
+        classes.push_back(s);
+    }
+    fclose(f);
+  }
+  if (classes.empty())
+  {
+    printf("# ULandmarkDnn::load: no class names in '%s'\n", classFile);
+    return false;
+  }
+  return true;
+}
+
+
+bool ULandmarkDnn::quantize(const vector<cv::Mat> & calibFrames)
+{
+  if (int8 or calibFrames.empty())
+    return int8;
+  vector<cv::Mat> calib;
+  for (const cv::Mat & img : calibFrames)
+    calib.push_back(cv::dnn::blobFromImage(img, scale, inputSize, mean, swapRB, false));
+  // keep float input and output, int8 inside
+  try
+  {
+    net = net.quantize(calib, CV_32F, CV_32F);
+  }
+  catch (const cv::Exception & e)
+  { // keep the float model
+    printf("# ULandmarkDnn::quantize: failed: %s\n", e.what());
+    return false;
+  }
+  int8 = not net.empty();
+  return int8;
+}
+
+
+bool ULandmarkDnn::detect(const cv::Mat & img, vector<ULandmark> & found)
+{
+  if (net.empty())
+    return false;
+  cv::dnn::blobFromImage(img, blob, scale, inputSize, mean, swapRB, false);
+  net.setInput(blob);
+  cv::Mat out = net.forward();
+  // rows of (image, class, confidence, left, top, right, bottom)
+  cv::Mat det(out.size[2], out.size[3], CV_32F, out.ptr<float>());
+  for (int i = 0; i < det.rows; i++)
+  {
+    const float * d = det.ptr<float>(i);
+    int id = int(d[1]);
+    if (d[2] < minConfidence or id < 0 or id >= int(classes.size()))
+      continue;
+    ULandmark lm;
+    lm.classId = id;
+    lm.name = classes[id].c_str();
+    lm.confidence = d[2];
+    lm.box = cv::Rect(cvRound(d[3] * img.cols), cvRound(d[4] * img.rows),
+                      cvRound((d[5] - d[3]) * img.cols), cvRound((d[6] - d[4]) * img.rows));
+    found.push_back(lm);
+  }
+  return true;
+}
+
+
+bool ULandmarkCascade::addClass(const char * name, const char * cascadeFile)
+{
+  cv::CascadeClassifier c;
+  if (not c.load(cascadeFile))
+  {
+    printf("# ULandmarkCascade::addClass: failed to load '%s'\n", cascadeFile);
+    return false;
+  }
+  cascades.push_back(c);
+  classes.push_back(name);
+  return true;
+}
+
+
+bool ULandmarkCascade::detect(const cv::Mat & img, vector<ULandmark> & found)
+{
+  if (cascades.empty())
+    return false;
+  // shared preprocessing for all classes
+  if (img.channels() == 3)
+    cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+  else
+    img.copyTo(gray);
+  cv::equalizeHist(gray, gray);
+  vector<cv::Rect> boxes;
+  for (int id = 0; id < int(cascades.size()); id++)
+  {
+    boxes.clear();
+    cascades[id].detectMultiScale(gray, boxes, 1.1, 3, 0, cv::Size(img.cols / 20, img.cols / 20));
+    for (const cv::Rect & r : boxes)
+    {
+      ULandmark lm;
+      lm.classId = id;
+      lm.name = classes[id].c_str();
+      lm.confidence = 1.0;
+      lm.box = r;
+      found.push_back(lm);
+    }
+  }
+  return true;
+}
+
+
+ULandmarkDetector::~ULandmarkDetector()
+{
+  delete backend;
+}
+
+
+bool ULandmarkDetector::loadDnn(const char * model, const char * classFile, bool int8,
+                                const vector<string> & calibFiles)
+{
+  ULandmarkDnn * dnn = new ULandmarkDnn();
+  if (not dnn->load(model, classFile))
+  {
+    delete dnn;
+    return false;
+  }
+  if (int8 and not dnn->int8)
+  { // quantise float model
+    vector<cv::Mat> calib;
+    for (const string & name : calibFiles)
+    {
+      cv::Mat img = cv::imread(name);
+      if (not img.empty())
+        calib.push_back(img);
+    }
+    if (not dnn->quantize(calib))
+      printf("# ULandmarkDetector::loadDnn: no int8 calibration, using float model\n");
+  }
+  delete backend;
+  backend = dnn;
+  return true;
+}
+
+
+bool ULandmarkDetector::loadCascade(const char * name, const char * cascadeFile)
+{
+  ULandmarkCascade * cascade = dynamic_cast<ULandmarkCascade *>(backend);
+  if (cascade == nullptr)
+  { // replace any other backend
+    delete backend;
+    cascade = new ULandmarkCascade();
+    backend = cascade;
+  }
+  return cascade->addClass(name, cascadeFile);
+}
+
+
+int ULandmarkDetector::detect(const cv::Mat & frame, vector<ULandmark> & found)
+{
+  found.clear();
+  if (backend == nullptr or frame.empty())
+    return 0;
+  TIMING_SCOPE("landmarks/detect");
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  // one downscaled image for all classes
+  double f = double(width) / frame.cols;
+  cv::resize(frame, small, cv::Size(width, cvRound(frame.rows * f)), 0, 0, cv::INTER_AREA);
+  backend->detect(small, found);
+  for (ULandmark & lm : found)
+  { // back to frame coordinates
+    lm.box = cv::Rect(cvRound(lm.box.x / f), cvRound(lm.box.y / f),
+                      cvRound(lm.box.width / f), cvRound(lm.box.height / f));
+    double xc = lm.box.x + lm.box.width / 2.0;
+    lm.bearing = angle2point(cvRound(xc * cameraModelWidth / frame.cols));
+  }
+  chrono::duration<float, milli> dt = chrono::steady_clock::now() - t0;
+  lastMs = dt.count();
+  calls++;
+  detectMetric->record(long(lastMs * 1000));
+  foundMetric->add(found.size());
+  if (calls == 1)
+    avgMs = lastMs;
+  else
+    avgMs = 0.9 * avgMs + 0.1 * lastMs;
+  // adjust resolution to the latency budget
+  if (lastMs > budgetMs)
+  {
+    overruns++;
+    if (avgMs > budgetMs)
+      width = max(minWidth, width * 4 / 5);
+  }
+  else if (avgMs < 0.6 * budgetMs)
+    width = min(maxWidth, width * 5 / 4);
+  return found.size();
+}
+
+
+const ULandmark * ULandmarkDetector::find(const vector<ULandmark> & found, const char * name)
+{
+  const ULandmark * best = NULL;
+  for (const ULandmark & lm : found)
+  {
+    if (strcmp(lm.name, name) == 0 and (best == NULL or lm.confidence > best->confidence))
+      best = &lm;
+  }
+  return best;
+}
+
+
+void ULandmarkDetector::printStatus()
+{
+  printf("# ------- Landmarks ----------\n");
+  if (backend == nullptr)
+  {
+    printf("# no detector loaded\n");
+    return;
+  }
+  printf("# backend %s, %d classes, width %d pixels\n",
+         backend->getName(), int(backend->classes.size()), width);
+  printf("# calls %d, last %.1f ms, avg %.1f ms, budget %.0f ms (%d overruns)\n",
+         calls, lastMs, avgMs, budgetMs, overruns);
+}
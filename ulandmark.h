@@ -0,0 +1,136 @@
+#ifndef ULANDMARK_H
+#define ULANDMARK_H
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+#include <opencv2/objdetect.hpp>
+
+/**
+ * A detected course landmark (tree, door, ...) */
+class ULandmark
+{
+public:
+  /// class index and name (from the detector class list)
+  int classId;
+  const char * name;
+  /// detection confidence 0..1
+  float confidence;
+  /// bounding box in the original frame [pixels]
+  cv::Rect box;
+  /// horizontal angle to box centre [degrees] - same camera model as for balls
+  double bearing;
+};
+
+/**
+ * Detector backend - finds all landmark classes in one pass
+ * over an (already downscaled) image. */
+class ULandmarkBackend
+{
+public:
+  virtual ~ULandmarkBackend() {}
+  /**
+   * Detect landmarks in 'img'. Boxes are in 'img' pixel coordinates.
+   * \returns false if the backend can not run */
+  virtual bool detect(const cv::Mat & img, std::vector<ULandmark> & found) = 0;
+  /** backend name for status */
+  virtual const char * getName() = 0;
+  /// class names, index is classId
+  std::vector<std::string> classes;
+  /// minimum confidence to report
+  float minConfidence = 0.5;
+};
+
+/**
+ * Small (SSD style) detection network run by OpenCV DNN on the CPU.
+ * The network output must be [1, 1, N, 7] with rows of
+ * (image, classId, confidence, left, top, right, bottom), coordinates 0..1. */
+class ULandmarkDnn : public ULandmarkBackend
+{
+public:
+  /**
+   * Load network (ONNX, TFLite, caffe ...) and class names (one per line).
+   * A model that is already quantised (int8) is used as is. */
+  bool load(const char * model, const char * classFile);
+  /**
+   * Quantise a float model to int8 using a few calibration frames
+   * (should be typical course images) */
+  bool quantize(const std::vector<cv::Mat> & calibFrames);
+  bool detect(const cv::Mat & img, std::vector<ULandmark> & found) override;
+  const char * getName() override { return int8 ? "dnn-int8" : "dnn"; }
+  /// network input size
+  cv::Size inputSize = cv::Size(300, 300);
+  /// input scale and mean (must match training)
+  double scale = 1.0 / 127.5;
+  cv::Scalar mean = cv::Scalar(127.5, 127.5, 127.5);
+  bool swapRB = true;
+  bool int8 = false;
+private:
+  cv::dnn::Net net;
+  cv::Mat blob;
+};
+
+/**
+ * One cascade classifier per class, run on the same
+ * grey and histogram equalized image. */
+class ULandmarkCascade : public ULandmarkBackend
+{
+public:
+  /** add a class with a trained cascade (xml) file */
+  bool addClass(const char * name, const char * cascadeFile);
+  bool detect(const cv::Mat & img, std::vector<ULandmark> & found) override;
+  const char * getName() override { return "cascade"; }
+private:
+  std::vector<cv::CascadeClassifier> cascades;
+  cv::Mat gray;
+};
+
+/**
+ * CPU landmark detector.
+ * The frame is downscaled, the backend finds all classes in one pass,
+ * and the result is scaled back with bearings from the camera model.
+ * The downscaled width is adjusted to stay within a latency budget. */
+class ULandmarkDetector
+{
+public:
+  ~ULandmarkDetector();
+  /**
+   * Use a DNN backend
+   * \param int8 if true and model is not quantised already,
+   *             then quantise using the images in 'calibFiles'. */
+  bool loadDnn(const char * model, const char * classFile, bool int8,
+               const std::vector<std::string> & calibFiles = std::vector<std::string>());
+  /** use cascade backend, add a class */
+  bool loadCascade(const char * name, const char * cascadeFile);
+  /** is a backend loaded */
+  bool isLoaded() { return backend != nullptr; }
+  /**
+   * Detect landmarks in a full frame
+   * \returns number of landmarks found */
+  int detect(const cv::Mat & frame, std::vector<ULandmark> & found);
+  /**
+   * Find the most confident landmark of this class
+   * \returns NULL if not found */
+  static const ULandmark * find(const std::vector<ULandmark> & found, const char * name);
+  /** print status to console */
+  void printStatus();
+public:
+  /// latency budget per frame [ms] (Raspberry Pi)
+  float budgetMs = 150;
+  /// downscaled width limits [pixels]
+  int minWidth = 160;
+  int maxWidth = 640;
+  /// current downscaled width
+  int width = 320;
+  /// statistics
+  int calls = 0;
+  int overruns = 0;
+  float lastMs = 0;
+  float avgMs = 0;
+private:
+  ULandmarkBackend * backend = nullptr;
+  cv::Mat small;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+
+#include "ulinelook.h"
+#include "utiming.h"
+
+using namespace std;
+
+
+ULineLook::ULineLook()
+{ // default calibration for the 320x240 reduced image,
+  // camera tilted down looking at the floor in front of the robot
+  const cv::Point2f pts[4] = {
+    cv::Point2f( 40, 235), // near-left
+    cv::Point2f(280, 235), // near-right
+    cv::Point2f(205, 120), // far-right
+    cv::Point2f(115, 120)  // far-left
+  };
+  setGroundPlane(pts);
+}
+
+
+ULineLook::~ULineLook()
+{
+  stop();
+}
+
+
+void ULineLook::setGroundPlane(const cv::Point2f imgPts[4])
+{
+  int cols = roundf(2 * halfWidth / resolution);
+  int rows = roundf((farX - nearX) / resolution);
+  // bird's-eye image has far end at row 0 and left side at column 0
+  const cv::Point2f topPts[4] = {
+    cv::Point2f(0, rows),    // near-left
+    cv::Point2f(cols, rows), // near-right
+    cv::Point2f(cols, 0),    // far-right
+    cv::Point2f(0, 0)        // far-left
+  };
+  toGround = cv::getPerspectiveTransform(imgPts, topPts);
+}
+
+
+void ULineLook::start(FrameSource frameSource)
+{
+  if (th1 == nullptr)
+  {
+    source = frameSource;
+    th1stop = false;
+    th1 = new thread(&ULineLook::run, this);
+  }
+}
+
+
+void ULineLook::stop()
+{
+  if (th1 != nullptr)
+  {
+    th1stop = true;
+    th1->join();
+    delete th1;
+    th1 = nullptr;
+  }
+}
+
+
+void ULineLook::run()
+{
+  UTracer::threadName("linelook");
+  cv::Mat frame;
+  while (not th1stop)
+  {
+    if (source and source(frame) and not frame.empty())
+      analyse(frame);
+    else
+      // no new frame - wait a bit
+      usleep(5000);
+  }
+}
+
+
+bool ULineLook::analyse(const cv::Mat & frame)
+{ // reduce first, so the rest is cheap
+  TIMING_SCOPE("linelook/analyse");
+  cv::resize(frame, small, reducedSize, 0, 0, cv::INTER_AREA);
+  if (small.channels() == 3)
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+  else
+    gray = small;
+  int cols = roundf(2 * halfWidth / resolution);
+  int rows = roundf((farX - nearX) / resolution);
+  cv::warpPerspective(gray, top, toGround, cv::Size(cols, rows), cv::INTER_LINEAR);
+  // white line is (much) brighter than the floor
+  cv::Scalar mean, dev;
+  cv::meanStdDev(top, mean, dev);
+  bool found = dev[0] > 10.0;
+  vector<cv::Point2f> pts;
+  if (found)
+  {
+    cv::threshold(top, mask, mean[0] + 1.5 * dev[0], 255, cv::THRESH_BINARY);
+    // follow the line from the near end, searching close to the last position
+    float lastCol = -1;
+    const int window = 4;
+    for (int r = rows - 1; r >= 0; r--)
+    {
+      const uchar * p = mask.ptr<uchar>(r);
+      int c0 = 0;
+      int c1 = cols;
+      if (lastCol >= 0)
+      {
+        c0 = max(0, int(lastCol) - window);
+        c1 = min(cols, int(lastCol) + window + 1);
+      }
+      int n = 0;
+      float sum = 0;
+      for (int c = c0; c < c1; c++)
+      {
+        if (p[c] > 0)
+        {
+          n++;
+          sum += c;
+        }
+      }
+      // skip empty rows and cross lines (white most of the width)
+      if (n == 0 or (lastCol < 0 and n > cols / 2))
+        continue;
+      lastCol = sum / n;
+      // to floor coordinates
+      float x = farX - (r + 0.5) * resolution;
+      float y = halfWidth - (lastCol + 0.5) * resolution;
+      pts.push_back(cv::Point2f(x, y));
+    }
+    found = pts.size() >= minRowFraction * rows;
+  }
+  float k = 0;
+  if (found)
+  { // least squares fit of y = a x^2 + b x + c
+    cv::Matx33d ata = cv::Matx33d::zeros();
+    cv::Vec3d aty(0, 0, 0);
+    for (const cv::Point2f & p : pts)
+    {
+      cv::Vec3d v(p.x * p.x, p.x, 1.0);
+      ata += v * v.t();
+      aty += v * double(p.y);
+    }
+    cv::Vec3d abc;
+    found = cv::solve(ata, aty, abc, cv::DECOMP_CHOLESKY);
+    if (found)
+    { // largest curvature within the look-ahead distance
+      const int MSP = 5;
+      for (int i = 0; i < MSP; i++)
+      {
+        float x = nearX + i * (farX - nearX) / (MSP - 1);
+        float slope = 2 * abc[0] * x + abc[1];
+        float ki = 2 * abc[0] / pow(1 + slope * slope, 1.5);
+        if (fabs(ki) > fabs(k))
+          k = ki;
+      }
+    }
+  }
+  dataLock.lock();
+  frames++;
+  if (found)
+  {
+    framesWithLine++;
+    curvature = k;
+    estimateTime = chrono::steady_clock::now();
+  }
+  estimateValid = found;
+  dataLock.unlock();
+  return found;
+}
+
+
+bool ULineLook::isValid(float maxAge)
+{
+  lock_guard<mutex> lock(dataLock);
+  if (not estimateValid)
+    return false;
+  chrono::duration<float> age = chrono::steady_clock::now() - estimateTime;
+  return age.count() < maxAge;
+}
+
+
+float ULineLook::getCurvature()
+{
+  lock_guard<mutex> lock(dataLock);
+  return curvature;
+}
+
+
+float ULineLook::getVelocity(float vMin, float vMax)
+{
+  if (not isValid())
+    return vMin;
+  float k = fabs(getCurvature());
+  float v = vMax;
+  if (k > 1e-3)
+    // lateral acceleration is v^2 * curvature
+    v = sqrt(latAcc / k);
+  return max(vMin, min(vMax, v));
+}
+
+
+void ULineLook::printStatus()
+{
+  printf("# ------- Line look-ahead ----------\n");
+  printf("# frames = %d, with line = %d, valid = %d\n", frames, framesWithLine, isValid());
+  printf("# curvature = %.2f 1/m (radius %.2f m), lateral acc limit = %.1f m/s^2\n",
+         getCurvature(), 1.0 / max(1e-3f, fabsf(getCurvature())), latAcc);
+}
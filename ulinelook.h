@@ -0,0 +1,98 @@
+#ifndef ULINELOOK_H
+#define ULINELOOK_H
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <opencv2/core.hpp>
+
+/**
+ * Camera look-ahead for line following.
+ * The camera frame is reduced to low resolution and warped to a bird's-eye
+ * view of the floor in front of the robot. The white line is found row by row
+ * and fitted with a parabola, and the curvature of the parabola over the
+ * look-ahead distance gives a velocity the edge follower can use
+ * without losing the line in the next curve.
+ *
+ * The floor coordinates are x ahead of the robot and y to the left (like the
+ * REGBOT), both in meters. */
+class ULineLook
+{
+public:
+  /// frame source, should return false if no new frame is available
+  typedef std::function<bool (cv::Mat &)> FrameSource;
+  /**
+   * constructor with a default ground-plane calibration */
+  ULineLook();
+  /** destructor, stops the analysis thread */
+  ~ULineLook();
+  /**
+   * Set the ground-plane calibration.
+   * \param imgPts are four points in the reduced image (see reducedSize)
+   *               in the order near-left, near-right, far-right, far-left,
+   *               matching the corners of the floor area (nearX..farX, +/-halfWidth).
+   * Place a sheet of paper on the floor and mark the corners to calibrate. */
+  void setGroundPlane(const cv::Point2f imgPts[4]);
+  /**
+   * Start analysis in own thread, taking frames from 'source' */
+  void start(FrameSource source);
+  /** stop analysis thread */
+  void stop();
+  /**
+   * Analyse one camera frame (BGR or gray)
+   * \returns true if a line was found */
+  bool analyse(const cv::Mat & frame);
+  /**
+   * Is the latest estimate valid
+   * \param maxAge is allowed age of estimate in seconds */
+  bool isValid(float maxAge = 0.3);
+  /**
+   * Largest curvature [1/m] of the line within the look-ahead distance,
+   * positive is turning left. Use only if isValid(). */
+  float getCurvature();
+  /**
+   * Velocity [m/s] that keeps the lateral acceleration below 'latAcc'
+   * in the curvature ahead.
+   * \returns 'vMin' if no valid line estimate */
+  float getVelocity(float vMin, float vMax);
+  /** print status to console */
+  void printStatus();
+
+public:
+  /// reduced image size used for warp
+  cv::Size reducedSize = cv::Size(320, 240);
+  /// floor area covered by the bird's-eye image [m]
+  float nearX = 0.20;
+  float farX = 1.00;
+  float halfWidth = 0.25;
+  /// bird's-eye resolution [m per pixel]
+  float resolution = 0.02;
+  /// allowed lateral acceleration [m/s^2]
+  float latAcc = 1.0;
+  /// minimum fraction of bird's-eye rows that must show the line
+  float minRowFraction = 0.4;
+  /// analysed frames and frames with a line found
+  int frames = 0;
+  int framesWithLine = 0;
+
+private:
+  /** thread loop */
+  void run();
+  /// transform from reduced image to bird's-eye image
+  cv::Mat toGround;
+  /// work images - kept to avoid reallocation
+  cv::Mat small, gray, top, mask;
+  /// latest estimate
+  float curvature = 0;
+  /// estimate time
+  std::chrono::steady_clock::time_point estimateTime;
+  bool estimateValid = false;
+  std::mutex dataLock;
+  /// analysis thread
+  FrameSource source;
+  std::thread * th1 = nullptr;
+  bool th1stop = false;
+};
+
+#endif
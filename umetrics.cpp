@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <vector>
+
+#include "umetrics.h"
+
+using namespace std;
+
+
+UHistogram::UHistogram()
+{
+  for (int i = 0; i < BUCKETS; i++)
+    cnt[i] = 0;
+}
+
+
+void UHistogram::record(long v)
+{
+  if (v < 0)
+    v = 0;
+  int b;
+  if (v < SUB)
+    b = v;
+  else
+  { // 16 sub buckets for each power of two
+    int m = 63 - __builtin_clzl(v);
+    int shift = m - 4;
+    b = (shift + 1) * SUB + int((v >> shift) - SUB);
+  }
+  cnt[b].fetch_add(1, memory_order_relaxed);
+  n.fetch_add(1, memory_order_relaxed);
+  sum.fetch_add(v, memory_order_relaxed);
+  long m = max.load(memory_order_relaxed);
+  while (v > m and not max.compare_exchange_weak(m, v, memory_order_relaxed))
+    ;
+}
+
+
+long UHistogram::bucketValue(int b)
+{
+  if (b < SUB)
+    return b;
+  int shift = b / SUB - 1;
+  long low = long(b % SUB + SUB) << shift;
+  // middle of bucket
+  return low + ((1L << shift) >> 1);
+}
+
+
+long UHistogram::quantile(double q)
+{
+  long total = count();
+  if (total == 0)
+    return 0;
+  long target = long(q * total);
+  long seen = 0;
+  for (int b = 0; b < BUCKETS; b++)
+  {
+    seen += cnt[b].load(memory_order_relaxed);
+    if (seen > target)
+      return min(bucketValue(b), getMax());
+  }
+  return getMax();
+}
+
+
+double UHistogram::mean()
+{
+  long c = count();
+  return c > 0 ? double(sum.load(memory_order_relaxed)) / c : 0;
+}
+
+
+/**
+ * All metrics and the exporter */
+class UMetricsRegistry
+{
+public:
+  mutex lock;
+  // sorted by name, never removed, so pointers stay valid
+  map<string, UCounter *> counters;
+  map<string, UGauge *> gauges;
+  map<string, UHistogram *> histograms;
+  // counter values at last exporter period, and rates over that period
+  map<string, long> lastCount;
+  map<string, double> rates;
+  chrono::steady_clock::time_point lastTime = chrono::steady_clock::now();
+  chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+  // exporter
+  thread * th = nullptr;
+  atomic<bool> stop{false};
+  string file;
+  int listenFd = -1;
+  int periodMs = 1000;
+  void run();
+  void serve();
+  /** update counter rates, by the exporter thread only */
+  void updateRates();
+};
+
+static UMetricsRegistry & registry()
+{ // also used from static objects in other files
+  static UMetricsRegistry reg;
+  return reg;
+}
+
+
+UCounter * UMetrics::counter(const char * name)
+{
+  UMetricsRegistry & r = registry();
+  lock_guard<mutex> guard(r.lock);
+  UCounter *& c = r.counters[name];
+  if (c == nullptr)
+    c = new UCounter();
+  return c;
+}
+
+
+UGauge * UMetrics::gauge(const char * name)
+{
+  UMetricsRegistry & r = registry();
+  lock_guard<mutex> guard(r.lock);
+  UGauge *& g = r.gauges[name];
+  if (g == nullptr)
+    g = new UGauge();
+  return g;
+}
+
+
+UHistogram * UMetrics::histogram(const char * name)
+{
+  UMetricsRegistry & r = registry();
+  lock_guard<mutex> guard(r.lock);
+  UHistogram *& h = r.histograms[name];
+  if (h == nullptr)
+    h = new UHistogram();
+  return h;
+}
+
+
+string UMetrics::snapshot()
+{
+  UMetricsRegistry & r = registry();
+  lock_guard<mutex> guard(r.lock);
+  chrono::duration<double> age = chrono::steady_clock::now() - r.startTime;
+  const int MSL = 300;
+  char s[MSL];
+  string text;
+  snprintf(s, MSL, "# metrics at %.3f sec\n", age.count());
+  text += s;
+  for (auto & c : r.counters)
+  {
+    auto rate = r.rates.find(c.first);
+    snprintf(s, MSL, "%s counter %ld rate %.1f\n", c.first.c_str(), c.second->get(),
+             rate != r.rates.end() ? rate->second : 0.0);
+    text += s;
+  }
+  for (auto & g : r.gauges)
+  {
+    snprintf(s, MSL, "%s gauge %g\n", g.first.c_str(), g.second->get());
+    text += s;
+  }
+  for (auto & h : r.histograms)
+  {
+    UHistogram * hp = h.second;
+    snprintf(s, MSL, "%s histogram n %ld mean %.0f p50 %ld p90 %ld p99 %ld max %ld\n",
+             h.first.c_str(), hp->count(), hp->mean(), hp->quantile(0.5),
+             hp->quantile(0.9), hp->quantile(0.99), hp->getMax());
+    text += s;
+  }
+  return text;
+}
+
+
+void UMetricsRegistry::updateRates()
+{
+  lock_guard<mutex> guard(lock);
+  chrono::steady_clock::time_point t = chrono::steady_clock::now();
+  chrono::duration<double> dt = t - lastTime;
+  lastTime = t;
+  for (auto & c : counters)
+  {
+    long v = c.second->get();
+    long & last = lastCount[c.first];
+    rates[c.first] = dt.count() > 0 ? (v - last) / dt.count() : 0;
+    last = v;
+  }
+}
+
+
+void UMetricsRegistry::serve()
+{ // one request, answer with the snapshot
+  int fd = accept(listenFd, NULL, NULL);
+  if (fd < 0)
+    return;
+  // an HTTP client sends a request first, nc sends nothing
+  char req[256];
+  struct pollfd p = {fd, POLLIN, 0};
+  int n = 0;
+  if (poll(&p, 1, 50) > 0)
+    n = recv(fd, req, sizeof(req), MSG_DONTWAIT);
+  string text = UMetrics::snapshot();
+  if (n >= 3 and strncmp(req, "GET", 3) == 0)
+    text = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n" + text;
+  send(fd, text.c_str(), text.size(), MSG_NOSIGNAL);
+  close(fd);
+}
+
+
+void UMetricsRegistry::run()
+{
+  chrono::steady_clock::time_point next = chrono::steady_clock::now();
+  while (not stop)
+  {
+    if (listenFd >= 0)
+    {
+      struct pollfd p = {listenFd, POLLIN, 0};
+      if (poll(&p, 1, 100) > 0)
+        serve();
+    }
+    else
+      usleep(100000);
+    if (chrono::steady_clock::now() < next)
+      continue;
+    next += chrono::milliseconds(periodMs);
+    updateRates();
+    if (not file.empty())
+    { // write to a temporary file and rename, so readers never see half a file
+      string tmp = file + ".tmp";
+      FILE * f = fopen(tmp.c_str(), "w");
+      if (f != NULL)
+      {
+        string text = UMetrics::snapshot();
+        fwrite(text.c_str(), 1, text.size(), f);
+        fclose(f);
+        rename(tmp.c_str(), file.c_str());
+      }
+    }
+  }
+}
+
+
+bool UMetrics::start(const char * file, int port, int periodMs)
+{
+  UMetricsRegistry & r = registry();
+  if (r.th != nullptr)
+    return true;
+  r.file = file != NULL ? file : "";
+  r.periodMs = max(100, periodMs);
+  if (port > 0)
+  {
+    r.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(r.listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    // loopback only
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(r.listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 or listen(r.listenFd, 4) != 0)
+    {
+      printf("# UMetrics::start: failed to listen on 127.0.0.1:%d\n", port);
+      close(r.listenFd);
+      r.listenFd = -1;
+    }
+  }
+  r.stop = false;
+  r.th = new thread(&UMetricsRegistry::run, &r);
+  return true;
+}
+
+
+void UMetrics::stop()
+{
+  UMetricsRegistry & r = registry();
+  if (r.th == nullptr)
+    return;
+  r.stop = true;
+  r.th->join();
+  delete r.th;
+  r.th = nullptr;
+  if (r.listenFd >= 0)
+  {
+    close(r.listenFd);
+    r.listenFd = -1;
+  }
+}
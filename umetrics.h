@@ -0,0 +1,83 @@
+#ifndef UMETRICS_H
+#define UMETRICS_H
+
+#include <atomic>
+#include <string>
+
+/**
+ * Event counter, e.g. frames captured */
+class UCounter
+{
+public:
+  void add(long n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  long get() { return value.load(std::memory_order_relaxed); }
+private:
+  std::atomic<long> value{0};
+};
+
+/**
+ * Current value, e.g. mission state */
+class UGauge
+{
+public:
+  void set(double v) { value.store(v, std::memory_order_relaxed); }
+  double get() { return value.load(std::memory_order_relaxed); }
+private:
+  std::atomic<double> value{0};
+};
+
+/**
+ * HDR style histogram of non-negative integer values (e.g. microseconds).
+ * Buckets are 16 per power of two, so values are kept with about 6% precision
+ * over the full range; recording is one atomic increment. */
+class UHistogram
+{
+public:
+  static const int SUB = 16;
+  static const int BUCKETS = 61 * SUB;
+  UHistogram();
+  void record(long v);
+  /**
+   * Value at this quantile (0..1) of all recorded values */
+  long quantile(double q);
+  long count() { return n.load(std::memory_order_relaxed); }
+  double mean();
+  long getMax() { return max.load(std::memory_order_relaxed); }
+private:
+  /** representative value for a bucket */
+  static long bucketValue(int b);
+  std::atomic<long> cnt[BUCKETS];
+  std::atomic<long> n{0};
+  std::atomic<long> sum{0};
+  std::atomic<long> max{0};
+};
+
+/**
+ * Registry of runtime metrics.
+ * Components get a metric once (e.g. into a static pointer) and update it
+ * without locks. Metrics are named 'component.what', e.g. 'camera.frames'.
+ * The exporter writes a text snapshot file periodically, and serves the same
+ * text to any connection on a loopback-only TCP port, e.g.:
+ *   curl http://127.0.0.1:24010    or    nc 127.0.0.1 24010
+ * Counters are shown with their rate over the last exporter period, so
+ * any number of readers (file, port, snapshot()) see the same rates. */
+class UMetrics
+{
+public:
+  /** get (or create) a metric with this name */
+  static UCounter * counter(const char * name);
+  static UGauge * gauge(const char * name);
+  static UHistogram * histogram(const char * name);
+  /**
+   * Start the exporter
+   * \param file snapshot file name (NULL for no file)
+   * \param port TCP port on 127.0.0.1 (0 for no port)
+   * \param periodMs snapshot period */
+  static bool start(const char * file, int port, int periodMs = 1000);
+  /** stop the exporter */
+  static void stop();
+  /** all metrics as text, one line each */
+  static std::string snapshot();
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "umissionbundle.h"
+#include "usnippetcode.h"
+#include "umetrics.h"
+
+using namespace std;
+
+/// runtime metrics
+static UCounter * reloadMetric = UMetrics::counter("bundle.reloads");
+
+
+UMissionBundle::~UMissionBundle()
+{
+  stop();
+}
+
+
+const UMissionBundle::USegment * UMissionBundle::UBundle::find(int state) const
+{
+  for (const USegment & seg : segments)
+  {
+    if (seg.state == state)
+      return &seg;
+  }
+  return nullptr;
+}
+
+
+/** value of 'key=' in line, 'otherwise' if not there */
+static int intValue(const char * line, const char * key, int otherwise)
+{
+  const char * p = strstr(line, key);
+  if (p == NULL)
+    return otherwise;
+  return strtol(p + strlen(key), NULL, 10);
+}
+
+
+shared_ptr<UMissionBundle::UBundle> UMissionBundle::parse(const string & file)
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    printf("# UMissionBundle::parse: failed to open '%s'\n", file.c_str());
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size == 0)
+  {
+    printf("# UMissionBundle::parse: '%s' is empty\n", file.c_str());
+    ::close(fd);
+    return nullptr;
+  }
+  const char * data = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    printf("# UMissionBundle::parse: failed to map '%s'\n", file.c_str());
+    return nullptr;
+  }
+  shared_ptr<UBundle> b = make_shared<UBundle>();
+  b->file = file;
+  const char * end = data + st.st_size;
+  const char * p = data;
+  int lineNum = 0;
+  int autoState = 10;
+  bool ok = true;
+  while (p < end)
+  {
+    const char * nl = (const char *)memchr(p, '\n', end - p);
+    if (nl == NULL)
+      nl = end;
+    string line(p, nl - p);
+    p = nl + 1;
+    lineNum++;
+    // trim
+    size_t a = line.find_first_not_of(" \t\r");
+    size_t z = line.find_last_not_of(" \t\r");
+    if (a == string::npos or line[a] == '#' or line[a] == '%')
+      continue;
+    line = line.substr(a, z - a + 1);
+    if (line.compare(0, 8, "segment ") == 0 or line.compare(0, 7, "thread=") == 0)
+    { // new segment
+      b->segments.emplace_back();
+      USegment & seg = b->segments.back();
+      if (line[0] == 's')
+      {
+        seg.state = intValue(line.c_str(), "state=", autoState);
+        seg.event = intValue(line.c_str(), "event=", -1);
+        const char * nm = strstr(line.c_str(), "name=");
+        if (nm != NULL)
+          seg.name = string(nm + 5, strcspn(nm + 5, " \t"));
+      }
+      else
+      {
+        seg.state = autoState;
+        seg.name = line;
+      }
+      autoState = seg.state + 2;
+      continue;
+    }
+    if (b->segments.empty())
+    {
+      printf("# UMissionBundle::parse: %s line %d: not in a segment\n", file.c_str(), lineNum);
+      ok = false;
+      continue;
+    }
+    USegment & seg = b->segments.back();
+    // check the line, repeat blocks are expanded at upload
+    USnippetCode::UItem items[USnippetCode::MAX_ITEMS];
+    int ac, cc;
+    if (not USnippetCode::parse(line.c_str(), items, USnippetCode::MAX_ITEMS, ac, cc) and
+        line.compare(0, 6, "repeat") != 0 and line != "end")
+      printf("# UMissionBundle::parse: %s line %d: unknown key or syntax '%s' (sent as is)\n",
+             file.c_str(), lineNum, line.c_str());
+    seg.lines.push_back(line);
+  }
+  munmap((void *)data, st.st_size);
+  for (USegment & seg : b->segments)
+  {
+    if (seg.event < 0)
+    { // completion event from last 'event=N' line
+      for (const string & l : seg.lines)
+        seg.event = intValue(l.c_str(), "event=", seg.event);
+    }
+    for (const string & l : seg.lines)
+      seg.text.push_back(l.c_str());
+  }
+  if (not ok)
+    return nullptr;
+  return b;
+}
+
+
+bool UMissionBundle::load(const char * file)
+{
+  stop();
+  fileName = file;
+  shared_ptr<UBundle> b = parse(fileName);
+  if (b == nullptr)
+    return false;
+  b->version = ++version;
+  atomic_store(&current, shared_ptr<const UBundle>(b));
+  printf("# UMissionBundle: loaded %s (%d segments)\n", file, int(b->segments.size()));
+  stopWatch = false;
+  th = new thread(&UMissionBundle::watch, this);
+  return true;
+}
+
+
+void UMissionBundle::stop()
+{
+  if (th == nullptr)
+    return;
+  stopWatch = true;
+  th->join();
+  delete th;
+  th = nullptr;
+}
+
+
+void UMissionBundle::watch()
+{
+  int fd = inotify_init1(IN_NONBLOCK);
+  if (fd < 0)
+  {
+    printf("# UMissionBundle::watch: no inotify, %s is not reloaded\n", fileName.c_str());
+    return;
+  }
+  // watch the directory, editors often write a new file and rename it
+  string dirName = fileName;
+  string baseName = fileName;
+  dirName = dirname(&dirName[0]);
+  baseName = basename(&baseName[0]);
+  if (inotify_add_watch(fd, dirName.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    printf("# UMissionBundle::watch: failed to watch %s\n", dirName.c_str());
+    ::close(fd);
+    return;
+  }
+  const int MBL = 4096;
+  char buf[MBL] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (not stopWatch)
+  {
+    struct pollfd pf = {fd, POLLIN, 0};
+    if (poll(&pf, 1, 200) <= 0)
+      continue;
+    bool changed = false;
+    int n;
+    while ((n = read(fd, buf, MBL)) > 0)
+    {
+      for (char * p = buf; p < buf + n; )
+      {
+        struct inotify_event * ev = (struct inotify_event *)p;
+        if (ev->len > 0 and baseName == ev->name)
+          changed = true;
+        p += sizeof(struct inotify_event) + ev->len;
+      }
+    }
+    if (not changed)
+      continue;
+    shared_ptr<UBundle> b = parse(fileName);
+    if (b == nullptr)
+    {
+      printf("# UMissionBundle::watch: %s has errors, keeping version %d\n", fileName.c_str(), version);
+      continue;
+    }
+    b->version = ++version;
+    atomic_store(&current, shared_ptr<const UBundle>(b));
+    reloadMetric->add();
+    printf("# UMissionBundle: reloaded %s version %d (%d segments)\n",
+           fileName.c_str(), version, int(b->segments.size()));
+  }
+  ::close(fd);
+}
@@ -0,0 +1,82 @@
+#ifndef UMISSIONBUNDLE_H
+#define UMISSIONBUNDLE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Mission snippets from a text file, so distances and velocities can be
+ * tuned without a rebuild. The file is in the REGBOT line format (as
+ * Cage_mision), split into segments by 'segment' lines:
+ *
+ *   # comment
+ *   segment state=10 event=1 name=ramp
+ *   servo=2, pservo=-850, vservo=200
+ *   vel=0.6,acc=3,edgel=0,white=1:dist=4.0
+ *   ...
+ *   event=1,vel=0.0
+ *   : dist=1
+ *   segment state=12 event=2 name=ball
+ *   ...
+ *
+ * A 'thread=N' line (as in Cage_mision) also starts a segment, numbered
+ * state 10, 12, 14 ... in file order, with the completion event from
+ * its last 'event=N' line.
+ * The file is memory mapped and parsed into a bundle. The file is watched
+ * (inotify), and a changed file is parsed into a new bundle, that replaces
+ * the old one atomically. A mission takes the current bundle (get()) when
+ * a segment starts, so a new version is used from the next segment. */
+class UMissionBundle
+{
+public:
+  /** one segment (snippet) */
+  class USegment
+  {
+  public:
+    int state = 0;
+    /// completion event, -1 if none
+    int event = -1;
+    std::string name;
+    std::vector<std::string> lines;
+    /// the lines as C strings (valid while the bundle exists)
+    std::vector<const char *> text;
+  };
+  /** a parsed version of the file */
+  class UBundle
+  {
+  public:
+    std::string file;
+    int version = 0;
+    std::vector<USegment> segments;
+    /** segment for this mission state, nullptr if none */
+    const USegment * find(int state) const;
+  };
+  ~UMissionBundle();
+  /**
+   * Load the file and start watching it for changes
+   * \returns false if the file can not be loaded */
+  bool load(const char * file);
+  /** stop watching */
+  void stop();
+  /** current bundle, nullptr if none loaded */
+  std::shared_ptr<const UBundle> get() { return std::atomic_load(&current); }
+  bool isLoaded() { return get() != nullptr; }
+
+private:
+  /**
+   * Map and parse the file
+   * \returns nullptr on error (printed) */
+  static std::shared_ptr<UBundle> parse(const std::string & file);
+  /** watch thread */
+  void watch();
+  std::string fileName;
+  std::shared_ptr<const UBundle> current;
+  std::thread * th = nullptr;
+  std::atomic<bool> stopWatch{false};
+  int version = 0;
+};
+
+#endif
@@ -0,0 +1,776 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <opencv2/imgcodecs.hpp>
+
+#include "umission.h"
+#include "umissionio.h"
+#include "utiming.h"
+#include "umetrics.h"
+#include "utracer.h"
+
+using namespace std;
+
+/// channels for values recorded on change
+enum { CH_HEARTBEAT, CH_MANUAL, CH_VEL, CH_TURNRATE, CH_DIST, CH_BUTTON };
+
+/// runtime metrics
+static UCounter * framesMetric = UMetrics::counter("camera.frames");
+static UCounter * stillsMetric = UMetrics::counter("camera.stills");
+static UCounter * sentMetric = UMetrics::counter("bridge.sent");
+static UCounter * sentBytesMetric = UMetrics::counter("bridge.sent_bytes");
+static UCounter * eventsMetric = UMetrics::counter("bridge.events");
+static UCounter * eventDropMetric = UMetrics::counter("bridge.event_drops");
+static UHistogram * eventDelayMetric = UMetrics::histogram("bridge.event_delay_us");
+/// time from send() to written, for each send class
+static UHistogram * sendDelayMetric[UMissionIO::SEND_CLASSES] =
+{
+  UMetrics::histogram("bridge.send_delay_us.control"),
+  UMetrics::histogram("bridge.send_delay_us.activate"),
+  UMetrics::histogram("bridge.send_delay_us.upload"),
+  UMetrics::histogram("bridge.send_delay_us.display")
+};
+static UCounter * coalescedMetric = UMetrics::counter("bridge.display_coalesced");
+static UCounter * sendDropMetric = UMetrics::counter("bridge.send_dropped");
+
+
+void UMissionIO::setup(UBridge * regbot, UCamera * camera)
+{
+  bridge = regbot;
+  cam = camera;
+  startTime = chrono::steady_clock::now();
+  const char * replayDir = getenv("MISSION_REPLAY");
+  const char * recordDir = getenv("MISSION_RECORD");
+  if (replayDir != NULL)
+    startReplay(replayDir);
+  else if (recordDir != NULL)
+    startRecording(recordDir);
+  if (not replay and bridge != nullptr and reactor.start())
+  {
+    reactor.addTimer(0.001, 0.001, [this]() {
+      eventFlags.poll([this](int n) { return pollEvent(n); }, EVENT_CNT); });
+    reactor.addTimer(0.005, 0.005, [this]() { pollJoy(); });
+    sendSignal = reactor.addSignal([this]() { sendQueued(); });
+  }
+}
+
+
+bool UMissionIO::startRecording(const char * recDir)
+{
+  close();
+  dir = recDir;
+  mkdir(recDir, 0755);
+  string name = dir + "/mission.rec";
+  lock.lock();
+  recFile = fopen(name.c_str(), "w");
+  for (int i = 0; i < MAX_CHANNELS; i++)
+    hasValue[i] = false;
+  imageCnt = 0;
+  if (recFile != NULL)
+  {
+    fprintf(recFile, "%% mission recording\n");
+    fprintf(recFile, "%% 1 time [sec]\n");
+    fprintf(recFile, "%% 2 type (send, event, clear (event or all), heartbeat, manual, buttonN, vel, turnrate, dist, frame, still, robot)\n");
+    fprintf(recFile, "%% 3 value\n");
+    printf("# UMissionIO: recording mission to %s\n", name.c_str());
+  }
+  else
+    printf("# UMissionIO: failed to open %s for recording\n", name.c_str());
+  lock.unlock();
+  return recFile != NULL;
+}
+
+
+bool UMissionIO::startReplay(const char * recDir)
+{
+  close();
+  dir = recDir;
+  string name = dir + "/mission.rec";
+  FILE * f = fopen(name.c_str(), "r");
+  if (f == NULL)
+  {
+    printf("# UMissionIO: failed to open %s for replay\n", name.c_str());
+    return false;
+  }
+  lock.lock();
+  events.clear();
+  values.clear();
+  images.clear();
+  nextImage.clear();
+  firstEvent = 0;
+  nextQueued = 0;
+  const int MSL = 1000;
+  char s[MSL];
+  while (fgets(s, MSL, f) != NULL)
+  {
+    double t;
+    char type[32];
+    int n = 0;
+    if (s[0] == '%' or sscanf(s, "%lf %31s %n", &t, type, &n) < 2)
+      continue;
+    char * value = s + n;
+    value[strcspn(value, "\r\n")] = '\0';
+    if (strcmp(type, "event") == 0)
+      events.push_back({t, atoi(value), false});
+    else if (strcmp(type, "frame") == 0 or strcmp(type, "still") == 0)
+      images[type].push_back(make_pair(t, string(value)));
+    else if (strcmp(type, "robot") == 0)
+      robotname = value;
+    else if (strcmp(type, "send") != 0 and strcmp(type, "clear") != 0)
+      values[type].push_back(make_pair(t, strtod(value, NULL)));
+  }
+  fclose(f);
+  name = dir + "/replay_send.txt";
+  sendFile = fopen(name.c_str(), "w");
+  replay = true;
+  replayTime = 0;
+  printf("# UMissionIO: replay of %s (%d events)\n", dir.c_str(), int(events.size()));
+  lock.unlock();
+  return true;
+}
+
+
+void UMissionIO::close()
+{
+  if (sendSignal >= 0)
+  { // send the rest, later sends are written at once
+    sendSignal = -1;
+    sendQueued();
+  }
+  reactor.stop();
+  lock_guard<mutex> guard(lock);
+  if (recFile != NULL)
+  {
+    fclose(recFile);
+    recFile = NULL;
+  }
+  if (sendFile != NULL)
+  {
+    fclose(sendFile);
+    sendFile = NULL;
+  }
+}
+
+
+double UMissionIO::now()
+{
+  if (replay)
+    return replayTime;
+  chrono::duration<double> t = chrono::steady_clock::now() - startTime;
+  return t.count();
+}
+
+
+void UMissionIO::sleep(int us)
+{
+  if (replay)
+  {
+    lock.lock();
+    replayTime += us * 1e-6;
+    lock.unlock();
+  }
+  else
+    usleep(us);
+}
+
+
+void UMissionIO::record(const char * type, const char * value)
+{
+  lock_guard<mutex> guard(lock);
+  if (recFile != NULL)
+    fprintf(recFile, "%.4f %s %s\n", now(), type, value);
+}
+
+
+void UMissionIO::recordChanged(const char * type, int channel, double value)
+{
+  if (recFile != NULL and channel < MAX_CHANNELS and
+      (not hasValue[channel] or lastValue[channel] != value))
+  {
+    hasValue[channel] = true;
+    lastValue[channel] = value;
+    const int MSL = 30;
+    char s[MSL];
+    snprintf(s, MSL, "%g", value);
+    record(type, s);
+  }
+}
+
+
+void UMissionIO::recordImage(const char * type, cv::Mat & img)
+{
+  if (recFile == NULL or img.empty())
+    return;
+  const int MNL = 64;
+  char name[MNL];
+  lock.lock();
+  snprintf(name, MNL, "%s_%05d.png", type, ++imageCnt);
+  lock.unlock();
+  // fast and lossless
+  cv::imwrite(dir + "/" + name, img, {cv::IMWRITE_PNG_COMPRESSION, 1});
+  record(type, name);
+}
+
+
+double UMissionIO::replayValue(const char * type, double otherwise)
+{
+  lock_guard<mutex> guard(lock);
+  map<string, vector<pair<double, double> > >::iterator it = values.find(type);
+  if (it == values.end())
+    return otherwise;
+  vector<pair<double, double> > & v = it->second;
+  // first value recorded after now
+  vector<pair<double, double> >::iterator after = upper_bound(v.begin(), v.end(),
+      make_pair(replayTime, 1e300));
+  if (after == v.begin())
+    return otherwise;
+  return (after - 1)->second;
+}
+
+
+bool UMissionIO::replayImage(const char * type, bool wait, cv::Mat & img)
+{
+  lock.lock();
+  vector<pair<double, string> > & v = images[type];
+  size_t & next = nextImage[type];
+  if (next >= v.size() or (not wait and v[next].first > replayTime))
+  { // no more images, or not yet
+    lock.unlock();
+    return false;
+  }
+  if (wait)
+    replayTime = max(replayTime, v[next].first);
+  else
+  { // like a camera stream, use the newest frame
+    while (next + 1 < v.size() and v[next + 1].first <= replayTime)
+      next++;
+  }
+  string name = dir + "/" + v[next].second;
+  next++;
+  lock.unlock();
+  img = cv::imread(name, cv::IMREAD_UNCHANGED);
+  return not img.empty();
+}
+
+
+void UMissionIO::send(const char * msg)
+{
+  sentMetric->add();
+  sentBytesMetric->add(strlen(msg));
+  UTracer::instant("send", "bridge", msg);
+  if (replay)
+  {
+    lock_guard<mutex> guard(lock);
+    if (sendFile != NULL)
+    { // one line for each message line, as in the recording
+      const char * p = msg;
+      do
+      {
+        int n = strcspn(p, "\n");
+        fprintf(sendFile, "%.4f send %.*s\n", replayTime, n, p);
+        p += n;
+        if (*p == '\n')
+          p++;
+      } while (*p != '\0');
+    }
+    return;
+  }
+  SendClass cls = sendClass(msg);
+  chrono::steady_clock::time_point t = chrono::steady_clock::now();
+  if (cls == SEND_CONTROL or sendSignal < 0)
+  { // not queued, waits for the message being written (if any)
+    lock_guard<mutex> guard(sendLock);
+    if (cls == SEND_CONTROL)
+    { // queued uploads and activations would start driving again after a stop
+      lock_guard<mutex> q(queueLock);
+      sendDropMetric->add(sendQueue.size());
+      sendQueue.clear();
+    }
+    write(msg, cls, t);
+  }
+  else
+  {
+    queueLock.lock();
+    bool coalesced = false;
+    if (cls == SEND_DISPLAY)
+    { // 'oled N text' - replace the queued text for the same line
+      const char * p = strchr(msg, ' ');
+      if (p != NULL)
+        p = strchr(p + 1, ' ');
+      int n = p != NULL ? p - msg + 1 : strlen(msg);
+      for (USendItem & item : displayQueue)
+      {
+        if (item.msg.compare(0, n, msg, n) == 0)
+        {
+          item.msg = msg;
+          coalesced = true;
+          coalescedMetric->add();
+          break;
+        }
+      }
+      if (not coalesced and int(displayQueue.size()) >= MAX_DISPLAY_QUEUE)
+        displayQueue.pop_front();
+      if (not coalesced)
+        displayQueue.push_back({msg, cls, t});
+    }
+    else
+      sendQueue.push_back({msg, cls, t});
+    queueLock.unlock();
+    reactor.signal(sendSignal);
+  }
+  if (recFile != NULL)
+  { // one record line for each message line
+    const char * p = msg;
+    while (*p != '\0')
+    {
+      int n = strcspn(p, "\n");
+      string line(p, n);
+      record("send", line.c_str());
+      p += n;
+      if (*p == '\n')
+        p++;
+    }
+  }
+}
+
+
+UMissionIO::SendClass UMissionIO::sendClass(const char * msg)
+{
+  if (strncmp(msg, "robot ", 6) == 0)
+    msg += 6;
+  if (strncmp(msg, "stop", 4) == 0)
+    return SEND_CONTROL;
+  // start runs the uploaded lines, so it must not pass them
+  if (strncmp(msg, "<event=", 7) == 0 or strncmp(msg, "start", 5) == 0)
+    return SEND_ACTIVATE;
+  if (strncmp(msg, "oled", 4) == 0)
+    return SEND_DISPLAY;
+  return SEND_UPLOAD;
+}
+
+
+void UMissionIO::write(const char * msg, int cls, chrono::steady_clock::time_point queued)
+{
+  bridge->send(msg);
+  chrono::duration<double, micro> dt = chrono::steady_clock::now() - queued;
+  sendDelayMetric[cls]->record(long(dt.count()));
+}
+
+
+void UMissionIO::sendQueued()
+{
+  while (true)
+  { // held while taking and writing one message, so two writers (reactor
+    // and close) keep the order, and a control message waits for one only
+    lock_guard<mutex> guard(sendLock);
+    USendItem item;
+    {
+      lock_guard<mutex> q(queueLock);
+      if (not sendQueue.empty())
+      {
+        item = std::move(sendQueue.front());
+        sendQueue.pop_front();
+      }
+      else if (not displayQueue.empty())
+      {
+        item = std::move(displayQueue.front());
+        displayQueue.pop_front();
+      }
+      else
+        break;
+    }
+    write(item.msg.c_str(), item.cls, item.queued);
+  }
+}
+
+
+void UMissionIO::subscribe()
+{
+  if (replay)
+    return;
+  // after the queued messages, and not mixed with a queued message being written
+  sendQueued();
+  lock_guard<mutex> guard(sendLock);
+  bridge->pose->subscribe();
+  bridge->edge->subscribe();
+  bridge->motor->subscribe();
+  bridge->event->subscribe();
+  bridge->joy->subscribe();
+  bridge->info->subscribe();
+  bridge->irdist->subscribe();
+  bridge->imu->subscribe();
+}
+
+
+int UMissionIO::replayEvent(int n, double before)
+{
+  for (size_t i = firstEvent; i < events.size() and events[i].t <= before; i++)
+  {
+    if (not events[i].used and events[i].n == n)
+      return i;
+  }
+  return -1;
+}
+
+
+void UMissionIO::eventTested(int n, bool isSet)
+{
+  if (isSet)
+  {
+    eventsMetric->add();
+    if (UTracer::enabled)
+    {
+      const int MSL = 20;
+      char s[MSL];
+      snprintf(s, MSL, "event %d", n);
+      UTracer::instant(s, "bridge");
+    }
+  }
+  if (eventHook)
+    eventHook(n, isSet);
+}
+
+
+bool UMissionIO::isEventSet(int n)
+{
+  bool isSet = false;
+  if (replay)
+  {
+    lock.lock();
+    int i = replayEvent(n, replayTime);
+    if (i >= 0)
+    {
+      events[i].used = true;
+      isSet = true;
+    }
+    while (firstEvent < events.size() and events[firstEvent].used)
+      firstEvent++;
+    lock.unlock();
+  }
+  else
+    isSet = eventFlags.test(n);
+  eventTested(n, isSet);
+  return isSet;
+}
+
+
+bool UMissionIO::waitForEvent(int n, double timeout)
+{
+  // an unset test when the wait starts, as a polling loop would have,
+  // so the snippet trace detect latency covers the wait
+  if (not isEventPending(n))
+    eventTested(n, false);
+  if (not replay)
+  {
+    bool isSet = eventFlags.waitForEvent(n, timeout);
+    eventTested(n, isSet);
+    return isSet;
+  }
+  // replay: advance time to the recorded event
+  lock.lock();
+  int i = replayEvent(n, timeout < 0 ? 1e300 : replayTime + timeout);
+  if (i >= 0)
+    replayTime = max(replayTime, events[i].t);
+  else if (timeout >= 0)
+    replayTime += timeout;
+  lock.unlock();
+  return isEventSet(n);
+}
+
+
+int UMissionIO::waitAny(uint64_t mask, double timeout)
+{
+  int n = -1;
+  bool pending = false;
+  for (int i = 0; i < UEventFlags::MAX_EVENTS and not pending; i++)
+    pending = (mask & UEventFlags::bit(i)) != 0 and isEventPending(i);
+  if (not pending)
+  { // an unset test of each event when the wait starts (see waitForEvent)
+    for (int i = 0; i < UEventFlags::MAX_EVENTS; i++)
+    {
+      if ((mask & UEventFlags::bit(i)) != 0)
+        eventTested(i, false);
+    }
+  }
+  if (not replay)
+  {
+    n = eventFlags.waitAny(mask, timeout);
+    if (n >= 0)
+      eventTested(n, true);
+    return n;
+  }
+  // replay: the first recorded event in mask
+  lock.lock();
+  double end = timeout < 0 ? 1e300 : replayTime + timeout;
+  for (size_t i = firstEvent; i < events.size() and events[i].t <= end; i++)
+  {
+    if (not events[i].used and events[i].n >= 0 and events[i].n < UEventFlags::MAX_EVENTS and
+        (mask & UEventFlags::bit(events[i].n)) != 0)
+    {
+      replayTime = max(replayTime, events[i].t);
+      n = events[i].n;
+      break;
+    }
+  }
+  if (n < 0 and timeout >= 0)
+    replayTime = end;
+  lock.unlock();
+  if (n >= 0)
+    isEventSet(n);
+  return n;
+}
+
+
+bool UMissionIO::isEventPending(int n)
+{
+  if (not replay)
+    return eventFlags.isSet(n);
+  lock_guard<mutex> guard(lock);
+  return replayEvent(n, replayTime) >= 0;
+}
+
+
+void UMissionIO::waitNewEvent(int us)
+{
+  if (replay)
+    sleep(us);
+  else
+    eventFlags.waitNext(us * 1e-6);
+}
+
+
+void UMissionIO::clearEvent(int n)
+{
+  if (replay)
+  { // the event is not used, if it is received until now
+    lock_guard<mutex> guard(lock);
+    for (size_t i = firstEvent; i < events.size() and events[i].t <= replayTime; i++)
+    {
+      if (events[i].n == n)
+        events[i].used = true;
+    }
+    return;
+  }
+  eventFlags.clear(n);
+  const int MSL = 10;
+  char s[MSL];
+  snprintf(s, MSL, "%d", n);
+  record("clear", s);
+}
+
+
+bool UMissionIO::pollEvent(int n)
+{
+  if (n == 0)
+  { // new poll of all events
+    pollPrev = pollTime;
+    pollTime = now();
+  }
+  if (not bridge->event->isEventSet(n))
+    return false;
+  // recorded at arrival, so replay has all events, also those never used
+  if (recFile != NULL)
+  {
+    const int MSL = 10;
+    char s[MSL];
+    snprintf(s, MSL, "%d", n);
+    record("event", s);
+  }
+  UEventItem e = {n, eventSeq++, pollTime, pollPrev, -1};
+  if (queueEvents and not eventQueue.push(e))
+    // mission is not taking events
+    eventDropMetric->add();
+  return true;
+}
+
+
+void UMissionIO::pollJoy()
+{
+  uint64_t state = bridge->joy->manual ? 1 : 0;
+  const int buttonCnt = sizeof(bridge->joy->button) / sizeof(bridge->joy->button[0]);
+  for (int i = 0; i < buttonCnt and i < 63; i++)
+  {
+    if (bridge->joy->button[i])
+      state |= uint64_t(2) << i;
+  }
+  if (state != joyState)
+  {
+    joyState = state;
+    eventFlags.wake();
+  }
+}
+
+
+bool UMissionIO::nextEvent(UEventItem & e)
+{
+  if (replay)
+  {
+    lock_guard<mutex> guard(lock);
+    if (nextQueued >= events.size() or events[nextQueued].t > replayTime)
+      return false;
+    URecEvent & r = events[nextQueued];
+    e = {r.n, unsigned(nextQueued), r.t, r.t, -1};
+    nextQueued++;
+  }
+  else
+  {
+    if (not eventQueue.pop(e))
+      return false;
+    eventDelayMetric->record(long((now() - e.host) * 1e6));
+  }
+  eventTested(e.n, true);
+  return true;
+}
+
+
+bool UMissionIO::takeEvent(int n, UEventItem & e)
+{
+  while (nextEvent(e))
+  {
+    if (e.n == n)
+      return true;
+  }
+  eventTested(n, false);
+  return false;
+}
+
+
+void UMissionIO::enableEventQueue(bool enable)
+{
+  queueEvents = enable;
+  clearEventQueue();
+}
+
+
+void UMissionIO::clearEventQueue()
+{
+  if (replay)
+  {
+    lock_guard<mutex> guard(lock);
+    while (nextQueued < events.size() and events[nextQueued].t <= replayTime)
+      nextQueued++;
+  }
+  else
+    eventQueue.clear();
+}
+
+
+void UMissionIO::clearEvents()
+{
+  if (replay)
+  { // events received until now are lost
+    lock_guard<mutex> guard(lock);
+    for (size_t i = firstEvent; i < events.size() and events[i].t <= replayTime; i++)
+      events[i].used = true;
+    while (nextQueued < events.size() and events[nextQueued].t <= replayTime)
+      nextQueued++;
+    return;
+  }
+  bridge->event->clearEvents();
+  eventFlags.clearAll();
+  eventQueue.clear();
+  record("clear", "");
+}
+
+
+bool UMissionIO::isHeartbeatOK()
+{
+  if (replay)
+    return replayValue("heartbeat", 1) != 0;
+  bool ok = bridge->info->isHeartbeatOK();
+  recordChanged("heartbeat", CH_HEARTBEAT, ok);
+  return ok;
+}
+
+
+bool UMissionIO::joyManual()
+{
+  if (replay)
+    return replayValue("manual", 0) != 0;
+  bool manual = bridge->joy->manual;
+  recordChanged("manual", CH_MANUAL, manual);
+  return manual;
+}
+
+
+bool UMissionIO::joyButton(int button)
+{
+  const int MSL = 20;
+  char s[MSL];
+  snprintf(s, MSL, "button%d", button);
+  if (replay)
+    return replayValue(s, 0) != 0;
+  bool pressed = bridge->joy->button[button];
+  recordChanged(s, CH_BUTTON + button, pressed);
+  return pressed;
+}
+
+
+float UMissionIO::velocity()
+{
+  if (replay)
+    return replayValue("vel", 0);
+  float v = bridge->motor->getVelocity();
+  recordChanged("vel", CH_VEL, v);
+  return v;
+}
+
+
+float UMissionIO::turnrate()
+{
+  if (replay)
+    return replayValue("turnrate", 0);
+  float r = bridge->imu->turnrate();
+  recordChanged("turnrate", CH_TURNRATE, r);
+  return r;
+}
+
+
+float UMissionIO::poseDist()
+{
+  if (replay)
+    return replayValue("dist", 0);
+  float d = bridge->pose->dist;
+  recordChanged("dist", CH_DIST, d);
+  return d;
+}
+
+
+const char * UMissionIO::robotName()
+{
+  if (replay)
+    return robotname.c_str();
+  if (recFile != NULL and robotname.empty())
+  {
+    robotname = bridge->info->robotname;
+    record("robot", robotname.c_str());
+  }
+  return bridge->info->robotname;
+}
+
+
+bool UMissionIO::capture(cv::Mat & img)
+{
+  TIMING_SCOPE("capture/stream");
+  framesMetric->add();
+  if (replay)
+    return replayImage("frame", false, img);
+  cam->capture(img);
+  recordImage("frame", img);
+  return not img.empty();
+}
+
+
+bool UMissionIO::captureStill(cv::Mat & img)
+{
+  TIMING_SCOPE("capture/still");
+  stillsMetric->add();
+  if (replay)
+    return replayImage("still", true, img);
+  system("libcamera-still -r -o img1.jpg");
+  img = cv::imread("img1.jpg");
+  recordImage("still", img);
+  return not img.empty();
+}
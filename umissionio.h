@@ -0,0 +1,263 @@
+#ifndef UMISSIONIO_H
+#define UMISSIONIO_H
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <functional>
+#include <opencv2/core.hpp>
+
+#include "ueventflags.h"
+#include "uspscqueue.h"
+#include "ureactor.h"
+
+class UBridge;
+class UCamera;
+
+/**
+ * Mission view of the robot bridge and the camera.
+ * Everything the mission sends to or reads from the REGBOT and the camera
+ * passes through here, so a mission run can be recorded with timestamps and
+ * later replayed into UMission without robot and camera, faster than real time.
+ *
+ * Recording starts if the environment variable MISSION_RECORD is set to a
+ * directory name, replay if MISSION_REPLAY is set to a recorded directory.
+ * The recording is the text file 'mission.rec' with one line per item:
+ * time [sec], item type and value, plus an image file per camera frame.
+ * In replay the sends are written to 'replay_send.txt' in the same directory,
+ * for comparison with the recorded sends.
+ *
+ * The bridge inputs are polled by timers in one reactor thread: REGBOT events
+ * are moved from the bridge to an event bitmap (every ms), so a mission can
+ * wait for an event and continue as soon as it arrives (waitForEvent,
+ * waitAny), and a gamepad change wakes the mission loop (waitNewEvent).
+ * The event poll tests and clears each bridge event flag, so an event set
+ * twice between two polls (1 ms) is seen once, and events found in the
+ * same poll are in event number order. When enabled (enableEventQueue), the
+ * poll also queues each event it finds with the poll time, so a mission can
+ * take every event found after a snippet was sent once (nextEvent, takeEvent)
+ * and not an older event with the same number.
+ *
+ * Sends are written in priority order (see SendClass): control messages
+ * (stop) are written at once, and wait at most for one other message,
+ * the rest is queued and written by the reactor thread. Snippet uploads and
+ * activations keep their order (an activation never passes its upload), and
+ * a stop drops those still queued (bridge.send_dropped), so the robot does
+ * not start again after the stop. Display messages go last, a newer text
+ * for the same OLED line replacing a queued one. */
+class UMissionIO
+{
+public:
+  /**
+   * A REGBOT event as received */
+  class UEventItem
+  {
+  public:
+    /// event number
+    int n;
+    /// arrival number, counts all events since setup
+    unsigned seq;
+    /// host time [sec] (as now()) of the poll that found the event,
+    /// and of the poll before - the event arrived between the two
+    double host;
+    double hostPrev;
+    /// REGBOT time [sec], -1 if not known (the bridge does not forward it)
+    double regbot;
+  };
+  /**
+   * Set bridge and camera, and start record or replay as set in environment */
+  void setup(UBridge * regbot, UCamera * camera);
+  /** start recording to this directory (created if needed) */
+  bool startRecording(const char * dir);
+  /** replay from this directory */
+  bool startReplay(const char * dir);
+  /** stop recording or replay */
+  void close();
+  bool isReplay() { return replay; }
+  bool isRecording() { return recFile != NULL; }
+  /**
+   * Time since setup [sec] - the recorded time in replay */
+  double now();
+  /**
+   * Wait this many microseconds (advances time only in replay) */
+  void sleep(int us);
+  // bridge
+  /// send priority, highest first
+  enum SendClass { SEND_CONTROL, SEND_ACTIVATE, SEND_UPLOAD, SEND_DISPLAY, SEND_CLASSES };
+  /** send message to bridge (and REGBOT), in priority order */
+  void send(const char * msg);
+  /** priority of a message, from its start (a 'robot ' prefix is skipped) */
+  static SendClass sendClass(const char * msg);
+  /** subscribe to the bridge data used in missions */
+  void subscribe();
+  /** test and clear event flag */
+  bool isEventSet(int n);
+  /**
+   * Wait for event n and clear it.
+   * \param timeout is max wait [sec], negative is forever
+   * \returns false on timeout */
+  bool waitForEvent(int n, double timeout);
+  /**
+   * Wait for any event in mask (bit n is event n) and clear it
+   * \returns the event number, or -1 on timeout */
+  int waitAny(uint64_t mask, double timeout);
+  /**
+   * Wait until a new event arrives, at most this many microseconds,
+   * e.g. in the mission loop instead of a sleep (advances time only in replay) */
+  void waitNewEvent(int us);
+  /** clear event flag, e.g. an old completion event, without using it */
+  void clearEvent(int n);
+  /** wake the mission loop (waitNewEvent), e.g. a result from another thread is ready */
+  void wake() { eventFlags.wake(); }
+  /**
+   * Queue events for nextEvent and takeEvent from now on (queued events are
+   * dropped), or stop queueing. Off at setup, so no events are queued
+   * (and dropped as overflow) when no mission takes them. */
+  void enableEventQueue(bool enable);
+  /**
+   * Next queued event, every event once, in order of poll (see above).
+   * Independent of the event flags (isEventSet and friends), but also
+   * given to the event hook. Mission thread only (one consumer).
+   * \returns false if no more events */
+  bool nextEvent(UEventItem & e);
+  /**
+   * Take queued events until event n, as nextEvent.
+   * If n is not found, this is given to the event hook as an unset test.
+   * \returns true if event n is found (in e) */
+  bool takeEvent(int n, UEventItem & e);
+  /** drop received events not yet taken by nextEvent (mission thread only) */
+  void clearEventQueue();
+  /**
+   * Function called with the result of every isEventSet(),
+   * e.g. for latency tracing */
+  void setEventHook(std::function<void (int n, bool isSet)> hook) { eventHook = hook; }
+  void clearEvents();
+  bool isHeartbeatOK();
+  bool joyManual();
+  bool joyButton(int button);
+  /** robot velocity [m/s] */
+  float velocity();
+  /** turn rate from gyro [deg/s] */
+  float turnrate();
+  /** driven distance from odometry [m] */
+  float poseDist();
+  const char * robotName();
+  // camera
+  /**
+   * Get frame from camera stream
+   * \returns false if no (new) frame */
+  bool capture(cv::Mat & img);
+  /**
+   * Take a full resolution still image (libcamera-still)
+   * \returns false if no image */
+  bool captureStill(cv::Mat & img);
+
+private:
+  /** add item to recording */
+  void record(const char * type, const char * value);
+  /** record value only if changed since last recorded */
+  void recordChanged(const char * type, int channel, double value);
+  /** save image to recording */
+  void recordImage(const char * type, cv::Mat & img);
+  /**
+   * Recorded value valid at current replay time
+   * \returns 'otherwise' if none */
+  double replayValue(const char * type, double otherwise);
+  /**
+   * Next recorded image of this type.
+   * \param wait if true, then replay time is advanced to the image time,
+   *             else only an image recorded before now is used. */
+  bool replayImage(const char * type, bool wait, cv::Mat & img);
+  /**
+   * Recorded event n, not used yet, at or before this time
+   * \returns index into events, -1 if none */
+  int replayEvent(int n, double before);
+  /** count and trace an event test */
+  void eventTested(int n, bool isSet);
+  /** is event n set (received, in replay until now), without clearing it */
+  bool isEventPending(int n);
+  /** reactor thread: test event n in the bridge, record and queue it if set */
+  bool pollEvent(int n);
+  /** reactor thread: wake the mission loop if the gamepad changed */
+  void pollJoy();
+  /** write queued messages, highest priority first (also to flush at close) */
+  void sendQueued();
+  /** write one message to the bridge, sendLock must be locked */
+  void write(const char * msg, int cls, std::chrono::steady_clock::time_point queued);
+
+  UBridge * bridge = nullptr;
+  UCamera * cam = nullptr;
+  /// REGBOT events (0..33) polled from the bridge
+  static const int EVENT_CNT = 34;
+  UEventFlags eventFlags;
+  /// thread for the bridge poll timers and the send signal
+  UReactor reactor;
+  /// events in order of poll, from reactor thread to mission thread
+  static const int EVENT_QUEUE_SIZE = 256;
+  USpscQueue<UEventItem, EVENT_QUEUE_SIZE> eventQueue;
+  std::atomic<bool> queueEvents{false};
+  /// used by reactor thread only
+  unsigned eventSeq = 0;
+  double pollTime = 0;
+  double pollPrev = 0;
+  /// gamepad state at last poll, manual in bit 0, button n in bit n + 1
+  uint64_t joyState = 0;
+  std::chrono::steady_clock::time_point startTime;
+  std::mutex lock;
+  std::string dir;
+  // recording
+  FILE * recFile = NULL;
+  static const int MAX_CHANNELS = 20;
+  double lastValue[MAX_CHANNELS];
+  bool hasValue[MAX_CHANNELS];
+  int imageCnt = 0;
+  // replay
+  bool replay = false;
+  double replayTime = 0;
+  /** recorded event */
+  class URecEvent
+  {
+  public:
+    double t;
+    int n;
+    bool used;
+  };
+  std::vector<URecEvent> events;
+  /// events before this are all used
+  size_t firstEvent = 0;
+  /// next event for nextEvent()
+  size_t nextQueued = 0;
+  /// recorded values and images for each type, in time order
+  std::map<std::string, std::vector<std::pair<double, double> > > values;
+  std::map<std::string, std::vector<std::pair<double, std::string> > > images;
+  std::map<std::string, size_t> nextImage;
+  std::string robotname;
+  FILE * sendFile = NULL;
+  /// message waiting to be written to the bridge
+  class USendItem
+  {
+  public:
+    std::string msg;
+    int cls;
+    std::chrono::steady_clock::time_point queued;
+  };
+  /// max queued display messages, the oldest is dropped
+  static const int MAX_DISPLAY_QUEUE = 20;
+  /// one writer to the bridge at a time
+  std::mutex sendLock;
+  std::mutex queueLock;
+  /// activations and uploads, in order
+  std::deque<USendItem> sendQueue;
+  /// display messages, coalesced
+  std::deque<USendItem> displayQueue;
+  /// reactor signal to write queued messages, -1 if not running
+  int sendSignal = -1;
+  std::function<void (int n, bool isSet)> eventHook;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+
+#include "umissiontask.h"
+#include "umetrics.h"
+
+using namespace std;
+
+/// runtime metrics
+static UCounter * resumeMetric = UMetrics::counter("task.resumes");
+static UGauge * taskMetric = UMetrics::gauge("task.running");
+
+
+UTaskScheduler::UTaskScheduler(function<double ()> clock, function<void ()> wake)
+{
+  this->clock = clock;
+  this->wake = wake;
+}
+
+
+double UTaskScheduler::now()
+{
+  if (clock)
+    return clock();
+  chrono::duration<double> t = chrono::steady_clock::now().time_since_epoch();
+  return t.count();
+}
+
+
+void UTaskScheduler::spawn(UMissionTask && task, const char * name)
+{
+  tasks.emplace_back(std::move(task), name);
+  tasks.back().started = now();
+  taskMetric->set(tasks.size());
+}
+
+
+void UTaskScheduler::wait(Condition cond, double deadline, bool * ok)
+{
+  if (current == nullptr)
+  {
+    printf("# UTaskScheduler::wait: co_await outside a task of this scheduler\n");
+    return;
+  }
+  current->cond = cond;
+  current->deadline = deadline;
+  current->ok = ok;
+}
+
+
+int UTaskScheduler::poll()
+{
+  double t = now();
+  // tasks spawned while polling are started at the next poll
+  size_t n = tasks.size();
+  auto it = tasks.begin();
+  for (size_t i = 0; i < n; i++)
+  {
+    UTaskEntry & e = *it;
+    bool resume = not e.cond;
+    if (not resume)
+    {
+      bool isTrue = e.cond();
+      resume = isTrue or (e.deadline >= 0 and t >= e.deadline);
+      if (resume and e.ok != nullptr)
+        *e.ok = isTrue;
+    }
+    if (resume)
+    {
+      e.cond = nullptr;
+      e.ok = nullptr;
+      e.resumes++;
+      resumeMetric->add();
+      current = &e;
+      e.task.handle().resume();
+      current = nullptr;
+    }
+    if (e.task.done())
+    {
+      printf("# task '%s' finished after %.3f sec (%d resumes)\n", e.name, t - e.started, e.resumes);
+      finishedCnt++;
+      it = tasks.erase(it);
+    }
+    else
+      it++;
+  }
+  taskMetric->set(tasks.size());
+  return tasks.size();
+}
+
+
+UTaskScheduler::UUntil UTaskScheduler::until(Condition cond, double timeout)
+{
+  return UUntil{this, cond, timeout < 0 ? -1 : now() + timeout};
+}
+
+
+UTaskScheduler::UUntil UTaskScheduler::sleep(double sec)
+{
+  double end = now() + sec;
+  return UUntil{this, [this, end]() { return now() >= end; }, -1};
+}
+
+
+void UTaskScheduler::clear()
+{
+  tasks.clear();
+  taskMetric->set(0);
+}
+
+
+void UTaskScheduler::printStatus()
+{
+  printf("# ------- Mission tasks ----------\n");
+  printf("# %d running, %d finished\n", int(tasks.size()), finishedCnt);
+  double t = now();
+  for (UTaskEntry & e : tasks)
+    printf("#   %-20s %6.2f sec, %d resumes%s\n", e.name, t - e.started, e.resumes,
+           e.cond ? ", waiting" : "");
+}
@@ -0,0 +1,175 @@
+#ifndef UMISSIONTASK_H
+#define UMISSIONTASK_H
+
+#include <coroutine>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <utility>
+
+/**
+ * A mission task is a C++20 coroutine, that waits with co_await
+ * instead of returning a new state to the mission loop:
+ *
+ *   UMissionTask drive(UMission * m)
+ *   {
+ *     co_await sendSnippet(...);   // upload, resumed at the acknowledge
+ *     if (not co_await sched.until([]() { return io.isEventSet(3); }, 20.0))
+ *       printf("no event 3 in 20 sec\n");
+ *   }
+ *   sched.spawn(drive(this), "drive");
+ *   sched.spawn(watch(this), "watch");   // runs while drive is waiting
+ *
+ * The task starts suspended and is run by UTaskScheduler::poll().
+ * The coroutine parameters are kept in the task, so pass pointers and
+ * values (not references to locals), and use lambdas without captures.
+ * A task must not block (e.g. sendAndActivateSnippet waits for the
+ * upload acknowledge), as all tasks run in the mission thread.
+ * Build with -std=c++20. */
+class UMissionTask
+{
+public:
+  class promise_type
+  {
+  public:
+    UMissionTask get_return_object()
+    {
+      return UMissionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+  UMissionTask(UMissionTask && other) : h(other.h) { other.h = nullptr; }
+  UMissionTask(const UMissionTask &) = delete;
+  UMissionTask & operator = (UMissionTask && other)
+  {
+    std::swap(h, other.h);
+    return *this;
+  }
+  ~UMissionTask() { if (h) h.destroy(); }
+  bool done() { return not h or h.done(); }
+  std::coroutine_handle<promise_type> handle() { return h; }
+
+private:
+  explicit UMissionTask(std::coroutine_handle<promise_type> handle) : h(handle) {}
+  std::coroutine_handle<promise_type> h;
+};
+
+
+/**
+ * Runs mission tasks in the mission thread.
+ * A waiting task has a condition, poll() resumes the tasks whose condition
+ * is true, so a task continues at the first poll after its event, and many
+ * tasks can wait at the same time without a thread each.
+ * Call poll() from the mission loop (it waits for the next REGBOT event). */
+class UTaskScheduler
+{
+public:
+  typedef std::function<bool ()> Condition;
+  /**
+   * Wait for a condition, co_await gives true if the condition is true,
+   * false on timeout */
+  class UUntil
+  {
+  public:
+    UTaskScheduler * sched;
+    Condition cond;
+    /// steady clock time [sec] to give up, negative is never
+    double deadline;
+    /// condition result (the condition may clear what it tests, e.g. an event)
+    bool ok = false;
+    bool await_ready() { ok = cond(); return ok; }
+    void await_suspend(std::coroutine_handle<>) { sched->wait(cond, deadline, &ok); }
+    bool await_resume() { return ok; }
+  };
+  /**
+   * Wait for a result from another thread (e.g. image analysis),
+   * co_await gives the result */
+  template <class T>
+  class UResult
+  {
+  public:
+    UTaskScheduler * sched;
+    std::future<T> result;
+    /// the thread, joined when the awaiter is destroyed
+    std::future<void> runner;
+    bool await_ready() { return isReady(); }
+    void await_suspend(std::coroutine_handle<>) { sched->wait([this]() { return isReady(); }, -1, nullptr); }
+    T await_resume() { return result.get(); }
+    bool isReady() { return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+  };
+  /**
+   * \param clock is the time source [sec] for timeouts and sleep, e.g. io.now()
+   *              so replay time is used, steady clock if empty
+   * \param wake is called (in the async thread) when an async result is ready,
+   *             e.g. to wake the mission loop that calls poll() */
+  UTaskScheduler(std::function<double ()> clock = nullptr, std::function<void ()> wake = nullptr);
+  /** add task, it starts at next poll() */
+  void spawn(UMissionTask && task, const char * name);
+  /**
+   * Resume every task that is new or whose condition is true (or timed out)
+   * \returns number of unfinished tasks */
+  int poll();
+  /** wait for condition, at most timeout [sec] (negative is forever) */
+  UUntil until(Condition cond, double timeout = -1);
+  /** wait this long [sec] */
+  UUntil sleep(double sec);
+  /** run function in a new thread, co_await gives its result */
+  template <class T>
+  UResult<T> async(std::function<T ()> func)
+  {
+    std::shared_ptr<std::promise<T> > p = std::make_shared<std::promise<T> >();
+    std::future<T> result = p->get_future();
+    std::function<void ()> w = wake;
+    // wake after the result is set, so the woken poll finds it ready
+    std::future<void> runner = std::async(std::launch::async, [p, func, w]() {
+      try
+      {
+        p->set_value(func());
+      }
+      catch (...)
+      {
+        p->set_exception(std::current_exception());
+      }
+      if (w)
+        w();
+    });
+    return UResult<T>{this, std::move(result), std::move(runner)};
+  }
+  /** remove all tasks (not finished tasks are destroyed) */
+  void clear();
+  void printStatus();
+
+private:
+  double now();
+  /**
+   * Called by awaiters, the current task waits for cond
+   * \param ok is set to the condition result when resumed */
+  void wait(Condition cond, double deadline, bool * ok);
+
+  class UTaskEntry
+  {
+  public:
+    UTaskEntry(UMissionTask && t, const char * taskName) : task(std::move(t)), name(taskName) {}
+    UMissionTask task;
+    const char * name;
+    /// waiting for this, empty when new
+    Condition cond;
+    double deadline = -1;
+    bool * ok = nullptr;
+    int resumes = 0;
+    double started = 0;
+  };
+  std::list<UTaskEntry> tasks;
+  std::function<double ()> clock;
+  std::function<void ()> wake;
+  /// task being resumed
+  UTaskEntry * current = nullptr;
+  int finishedCnt = 0;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <mutex>
+
+#include "uperfcount.h"
+
+using namespace std;
+
+bool UPerfCount::enabled = getenv("MISSION_PERF") != NULL;
+
+/// all counters, for status and log (counters may be static in other files)
+static vector<UPerfCount *> & allCounters()
+{
+  static vector<UPerfCount *> counters;
+  return counters;
+}
+static mutex & countersLock()
+{
+  static mutex lock;
+  return lock;
+}
+
+static const char * counterNames[UPerfCount::MAX_COUNTERS] =
+    {"cycles", "instructions", "cache-refs", "cache-misses", "branches", "branch-misses"};
+
+static const unsigned long long counterConfig[UPerfCount::MAX_COUNTERS] =
+{
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_REFERENCES,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+
+
+UPerfCount::UPerfCount(const char * sectionName, bool all, bool isListed)
+{
+  name = sectionName;
+  allThreads = all;
+  listed = isListed;
+  for (int i = 0; i < MAX_COUNTERS; i++)
+  {
+    last[i] = 0;
+    sum[i] = 0;
+    available[i] = false;
+  }
+  if (not listed)
+    return;
+  lock_guard<mutex> guard(countersLock());
+  allCounters().push_back(this);
+}
+
+
+UPerfCount::~UPerfCount()
+{
+  for (UGroup & g : groups)
+    for (int i = 0; i < g.cnt; i++)
+      close(g.fd[i]);
+  if (not listed)
+    return;
+  lock_guard<mutex> guard(countersLock());
+  vector<UPerfCount *> & counters = allCounters();
+  for (size_t i = 0; i < counters.size(); i++)
+  {
+    if (counters[i] == this)
+    {
+      counters.erase(counters.begin() + i);
+      break;
+    }
+  }
+}
+
+
+bool UPerfCount::openGroup(int tid)
+{
+  UGroup g;
+  for (int i = 0; i < MAX_COUNTERS; i++)
+  {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = counterConfig[i];
+    pe.disabled = g.cnt == 0;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int leader = g.cnt == 0 ? -1 : g.fd[0];
+    int fd = syscall(__NR_perf_event_open, &pe, tid, -1, leader, 0);
+    if (fd < 0)
+    {
+      if (g.cnt == 0 and i == CYCLES)
+      { // no cycle counter, no group
+        printf("# UPerfCount: perf_event_open failed for '%s': %s "
+               "(see /proc/sys/kernel/perf_event_paranoid)\n", name, strerror(errno));
+        return false;
+      }
+      // not all CPUs have all counters
+      continue;
+    }
+    g.fd[g.cnt] = fd;
+    g.counter[g.cnt] = i;
+    g.cnt++;
+    available[i] = true;
+  }
+  groups.push_back(g);
+  return true;
+}
+
+
+bool UPerfCount::open()
+{
+  opened = true;
+  if (not allThreads)
+    return openGroup(0);
+  // one group for each thread in the process
+  DIR * dir = opendir("/proc/self/task");
+  if (dir == NULL)
+    return false;
+  struct dirent * de;
+  while ((de = readdir(dir)) != NULL)
+  {
+    int tid = atoi(de->d_name);
+    if (tid > 0)
+      openGroup(tid);
+  }
+  closedir(dir);
+  return not groups.empty();
+}
+
+
+void UPerfCount::start()
+{
+  if (not enabled or failed)
+    return;
+  if (not opened and not open())
+  {
+    failed = true;
+    return;
+  }
+  for (UGroup & g : groups)
+  {
+    ioctl(g.fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g.fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+
+void UPerfCount::stop()
+{
+  if (not enabled or failed or groups.empty())
+    return;
+  for (int i = 0; i < MAX_COUNTERS; i++)
+    last[i] = 0;
+  for (UGroup & g : groups)
+  {
+    ioctl(g.fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time enabled, time running, values
+    unsigned long long data[3 + MAX_COUNTERS];
+    ssize_t n = read(g.fd[0], data, sizeof(data));
+    if (n < ssize_t(3 * sizeof(data[0])) or data[0] != (unsigned long long)g.cnt)
+      continue;
+    // scale, if the group was multiplexed with other perf users
+    double scale = 1;
+    if (data[2] > 0 and data[2] < data[1])
+      scale = double(data[1]) / data[2];
+    for (int i = 0; i < g.cnt; i++)
+      last[g.counter[i]] += data[3 + i] * scale;
+  }
+  for (int i = 0; i < MAX_COUNTERS; i++)
+    sum[i] += last[i];
+  calls++;
+}
+
+
+void UPerfCount::add(const UPerfCount & other)
+{
+  if (not enabled or other.calls == 0)
+    return;
+  // the lock of printAll and logAll
+  lock_guard<mutex> guard(countersLock());
+  for (int i = 0; i < MAX_COUNTERS; i++)
+  {
+    last[i] = other.last[i];
+    sum[i] += other.last[i];
+    available[i] = available[i] or other.available[i];
+  }
+  calls++;
+}
+
+
+void UPerfCount::printStatus()
+{
+  if (calls == 0)
+  {
+    printf("# %-16s no calls\n", name);
+    return;
+  }
+  double ipc = sum[CYCLES] > 0 ? sum[INSTRUCTIONS] / sum[CYCLES] : 0;
+  double kInstr = sum[INSTRUCTIONS] / 1000;
+  printf("# %-16s %5d calls, %7.2f Mcycles/call, IPC %.2f", name, calls,
+         sum[CYCLES] / calls / 1e6, ipc);
+  if (available[CACHE_MISSES] and available[CACHE_REFS] and sum[CACHE_REFS] > 0)
+    printf(", cache miss %.1f%% (%.2f/kinstr)", sum[CACHE_MISSES] / sum[CACHE_REFS] * 100,
+           kInstr > 0 ? sum[CACHE_MISSES] / kInstr : 0);
+  if (available[BRANCH_MISSES] and available[BRANCHES] and sum[BRANCHES] > 0)
+    printf(", branch miss %.1f%%", sum[BRANCH_MISSES] / sum[BRANCHES] * 100);
+  printf("\n");
+}
+
+
+void UPerfCount::logStats(FILE * f)
+{
+  if (f == NULL or calls == 0)
+    return;
+  fprintf(f, "%% perf %s calls %d", name, calls);
+  for (int i = 0; i < MAX_COUNTERS; i++)
+  {
+    if (available[i])
+      fprintf(f, " %s %.0f", counterNames[i], sum[i] / calls);
+  }
+  fprintf(f, " per call\n");
+}
+
+
+void UPerfCount::printAll()
+{
+  if (not enabled)
+    return;
+  printf("# ------- Performance counters ----------\n");
+  lock_guard<mutex> guard(countersLock());
+  for (UPerfCount * pc : allCounters())
+    pc->printStatus();
+}
+
+
+void UPerfCount::logAll(FILE * f)
+{
+  if (not enabled)
+    return;
+  lock_guard<mutex> guard(countersLock());
+  for (UPerfCount * pc : allCounters())
+    pc->logStats(f);
+}
@@ -0,0 +1,89 @@
+#ifndef UPERFCOUNT_H
+#define UPERFCOUNT_H
+
+#include <stdio.h>
+#include <vector>
+
+/**
+ * Hardware performance counters (Linux perf_event_open) for a code section:
+ * cycles, instructions, cache references and misses, branches and branch misses,
+ * read as one group, so the ratios (IPC, miss rates) are consistent.
+ * Counting is only in user space, so it works with perf_event_paranoid <= 2.
+ *
+ * Counters are used only if the environment variable MISSION_PERF is set,
+ * otherwise start() and stop() do nothing.
+ * All counters are listed by printAll() and logAll(). */
+class UPerfCount
+{
+public:
+  enum { CYCLES, INSTRUCTIONS, CACHE_REFS, CACHE_MISSES, BRANCHES, BRANCH_MISSES, MAX_COUNTERS };
+  /**
+   * \param name section name, must be a constant string
+   * \param allThreads if false, then the thread calling the first start() is counted,
+   *                   else all threads of the process at that time
+   * \param listed if false, then not in printAll() and logAll()
+   *               (e.g. a thread_local counter that is added to a listed one) */
+  UPerfCount(const char * name, bool allThreads = false, bool listed = true);
+  ~UPerfCount();
+  /** start counting (counters are opened the first time) */
+  void start();
+  /** stop counting and add to statistics */
+  void stop();
+  /**
+   * Add the last call of another counter as a call of this,
+   * e.g. one counter per thread for a function called from more threads */
+  void add(const UPerfCount & other);
+  /** print one status line (IPC and miss rates) */
+  void printStatus();
+  /** write a '% perf' line to a logfile */
+  void logStats(FILE * f);
+  /** print all counters */
+  static void printAll();
+  /** log all counters */
+  static void logAll(FILE * f);
+  /// use counters (MISSION_PERF set)
+  static bool enabled;
+
+public:
+  const char * name;
+  /// counts for last call and sum of all calls (scaled if multiplexed)
+  double last[MAX_COUNTERS];
+  double sum[MAX_COUNTERS];
+  /// counter is available on this CPU
+  bool available[MAX_COUNTERS];
+  int calls = 0;
+
+private:
+  /** open counter groups */
+  bool open();
+  /** open one group for a thread (0 is the calling thread) */
+  bool openGroup(int tid);
+  /**
+   * Counters for one thread, the first is the group leader */
+  class UGroup
+  {
+  public:
+    int fd[MAX_COUNTERS];
+    /// counter for each position in the group read
+    int counter[MAX_COUNTERS];
+    int cnt = 0;
+  };
+  std::vector<UGroup> groups;
+  bool allThreads;
+  bool listed;
+  bool opened = false;
+  bool failed = false;
+};
+
+/**
+ * Count from construction to destruction */
+class UPerfScope
+{
+public:
+  UPerfScope(UPerfCount & counter) : pc(counter) { pc.start(); }
+  ~UPerfScope() { pc.stop(); }
+private:
+  UPerfCount & pc;
+};
+
+#endif
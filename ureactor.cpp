@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <chrono>
+
+#include "ureactor.h"
+#include "umetrics.h"
+#include "utracer.h"
+
+using namespace std;
+
+/// runtime metrics
+static UCounter * wakeupMetric = UMetrics::counter("reactor.wakeups");
+static UHistogram * handlerMetric = UMetrics::histogram("reactor.handler_us");
+
+
+UReactor::~UReactor()
+{
+  stop();
+}
+
+
+bool UReactor::start()
+{
+  if (th1 != nullptr)
+    return true;
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epfd < 0 or stopFd < 0)
+  {
+    printf("# UReactor::start: failed to create epoll: %s\n", strerror(errno));
+    return false;
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = stopFd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, stopFd, &ev);
+  th1 = new thread(&UReactor::run, this);
+  return true;
+}
+
+
+void UReactor::stop()
+{
+  if (th1 != nullptr)
+  {
+    uint64_t one = 1;
+    if (write(stopFd, &one, sizeof(one)) < 0)
+      printf("# UReactor::stop: failed to wake thread: %s\n", strerror(errno));
+    th1->join();
+    delete th1;
+    th1 = nullptr;
+  }
+  lock_guard<mutex> guard(lock);
+  for (auto & e : entries)
+    close(e.first);
+  entries.clear();
+  if (stopFd >= 0)
+    close(stopFd);
+  if (epfd >= 0)
+    close(epfd);
+  stopFd = -1;
+  epfd = -1;
+}
+
+
+bool UReactor::add(int fd, Handler handler)
+{
+  if (epfd < 0)
+  {
+    printf("# UReactor::add: reactor is not started\n");
+    return false;
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    entries[fd] = handler;
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    printf("# UReactor::add: failed to add fd %d: %s\n", fd, strerror(errno));
+    lock_guard<mutex> guard(lock);
+    entries.erase(fd);
+    return false;
+  }
+  return true;
+}
+
+
+int UReactor::addTimer(double sec, double period, Handler handler)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (fd < 0)
+  {
+    printf("# UReactor::addTimer: failed to create timer: %s\n", strerror(errno));
+    return -1;
+  }
+  itimerspec ts = {};
+  // zero would disarm the timer
+  long first = sec > 1e-9 ? long(sec * 1e9) : 1;
+  long every = long(period * 1e9);
+  ts.it_value.tv_sec = first / 1000000000;
+  ts.it_value.tv_nsec = first % 1000000000;
+  ts.it_interval.tv_sec = every / 1000000000;
+  ts.it_interval.tv_nsec = every % 1000000000;
+  if (not add(fd, handler))
+  {
+    close(fd);
+    return -1;
+  }
+  timerfd_settime(fd, 0, &ts, NULL);
+  return fd;
+}
+
+
+int UReactor::addSignal(Handler handler)
+{
+  int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd < 0)
+  {
+    printf("# UReactor::addSignal: failed to create eventfd: %s\n", strerror(errno));
+    return -1;
+  }
+  if (not add(fd, handler))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+void UReactor::signal(int id)
+{
+  uint64_t one = 1;
+  if (id >= 0 and write(id, &one, sizeof(one)) < 0 and errno != EAGAIN)
+    printf("# UReactor::signal: failed to signal %d: %s\n", id, strerror(errno));
+}
+
+
+void UReactor::run()
+{
+  UTracer::threadName("reactor");
+  const int MAX_EVENTS = 16;
+  epoll_event evs[MAX_EVENTS];
+  while (true)
+  {
+    int n = epoll_wait(epfd, evs, MAX_EVENTS, -1);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      printf("# UReactor::run: epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+    wakeupMetric->add();
+    for (int i = 0; i < n; i++)
+    {
+      int fd = evs[i].data.fd;
+      if (fd == stopFd)
+        return;
+      Handler handler;
+      {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(fd);
+        if (it == entries.end())
+          continue;
+        handler = it->second;
+      }
+      // timer expirations or signal count, not used
+      uint64_t cnt;
+      if (read(fd, &cnt, sizeof(cnt)) < 0)
+        continue;
+      chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+      handler();
+      chrono::duration<double, micro> dt = chrono::steady_clock::now() - t0;
+      handlerMetric->record(long(dt.count()));
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef UREACTOR_H
+#define UREACTOR_H
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+/**
+ * One thread that waits (epoll) for timers and signals, and calls a
+ * handler for each, instead of a thread per task that sleeps:
+ *   - timers (timerfd), once or periodic
+ *   - signals from other threads (eventfd), e.g. 'a new frame is ready'
+ * The bridge and camera libraries give no file descriptor to wait for,
+ * so their inputs are polled from timers.
+ * Handlers run in the reactor thread and should be short.
+ *
+ *   reactor.start();
+ *   int t = reactor.addTimer(0.001, 0.001, []() { pollBridge(); });
+ *   int s = reactor.addSignal([]() { useFrame(); });
+ *   ...
+ *   reactor.signal(s);   // from the camera thread
+ * */
+class UReactor
+{
+public:
+  typedef std::function<void ()> Handler;
+  /** destructor, stops the thread */
+  ~UReactor();
+  /** start reactor thread */
+  bool start();
+  /** stop thread and close timers and signals */
+  void stop();
+  bool isRunning() { return th1 != nullptr; }
+  /**
+   * Timer, first after 'sec' seconds, then every 'period' seconds (0 is once)
+   * \returns timer ID, -1 on error */
+  int addTimer(double sec, double period, Handler handler);
+  /**
+   * Handler called (in the reactor thread) when signal(id) is called.
+   * More signals before the handler runs give one call.
+   * \returns signal ID, -1 on error */
+  int addSignal(Handler handler);
+  /** wake the reactor for this signal, from any thread */
+  void signal(int id);
+
+private:
+  void run();
+  /** add timer or signal fd to epoll and handler list */
+  bool add(int fd, Handler handler);
+
+  int epfd = -1;
+  /// eventfd to stop the thread
+  int stopFd = -1;
+  std::mutex lock;
+  /// handler for each timer and signal fd, read and closed by the reactor
+  std::map<int, Handler> entries;
+  std::thread * th1 = nullptr;
+};
+
+#endif
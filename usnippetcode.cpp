@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "usnippetcode.h"
+
+/// keys of assignments and conditions in REGBOT mission lines (index is the code)
+static const char * keys[] =
+{
+  "vel", "acc", "tr", "edgel", "edger", "white", "servo", "pservo",
+  "vservo", "event", "irsensor", "irdist", "log", "bal", "head", "topos",
+  "label", "goto", "dist", "time", "turn", "lv", "xl", "xb",
+  "ir1", "ir2", "count", "last", "reason", "thread"
+};
+
+static const int keyCnt = sizeof(keys) / sizeof(keys[0]);
+
+static const char ops[] = "=<>";
+
+/// value is a float (not value * 100 in an int16)
+static const int FLOAT_MARK = 0x7fff;
+
+
+int USnippetCode::key(const char * name)
+{
+  for (int i = 0; i < keyCnt; i++)
+  {
+    if (strcmp(keys[i], name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+bool USnippetCode::parse(const char * line, UItem * items, int maxItems, int & assignCnt, int & condCnt)
+{
+  assignCnt = 0;
+  condCnt = 0;
+  bool inCond = false;
+  const char * p = line;
+  while (true)
+  {
+    while (*p == ' ' or *p == ',' or *p == '\t')
+      p++;
+    if (*p == ':')
+    {
+      if (inCond)
+        return false;
+      inCond = true;
+      p++;
+      continue;
+    }
+    if (*p == '\0' or *p == '\n')
+      break;
+    // key
+    const char * k = p;
+    while ((*p >= 'a' and *p <= 'z') or (*p >= '0' and *p <= '9'))
+      p++;
+    int kn = p - k;
+    while (*p == ' ')
+      p++;
+    const char * o = strchr(ops, *p);
+    if (kn == 0 or *p == '\0' or o == NULL)
+      return false;
+    p++;
+    char * end;
+    float v = strtof(p, &end);
+    if (end == p)
+      return false;
+    p = end;
+    int key = -1;
+    for (int i = 0; i < keyCnt and key < 0; i++)
+    {
+      if (int(strlen(keys[i])) == kn and strncmp(keys[i], k, kn) == 0)
+        key = i;
+    }
+    int n = assignCnt + condCnt;
+    if (key < 0 or n >= maxItems)
+      return false;
+    if (not inCond and o != ops)
+      // assignment must be '='
+      return false;
+    items[n].key = key;
+    items[n].op = o - ops;
+    items[n].value = v;
+    if (inCond)
+      condCnt++;
+    else if (condCnt == 0)
+      assignCnt++;
+    else
+      return false;
+  }
+  return assignCnt <= 15 and condCnt <= 15;
+}
+
+
+void USnippetCode::format(UItem * items, int assignCnt, int condCnt, char * text, int maxLen)
+{
+  int n = 0;
+  text[0] = '\0';
+  for (int i = 0; i < assignCnt + condCnt and n < maxLen; i++)
+  {
+    const char * sep = "";
+    if (i == assignCnt)
+      sep = ":";
+    else if (i > 0)
+      sep = ",";
+    n += snprintf(text + n, maxLen - n, "%s%s%c%g", sep, keys[items[i].key],
+                  ops[items[i].op], items[i].value);
+  }
+}
+
+
+int USnippetCode::compile(const char * line, uint8_t * code, int maxCode)
+{
+  const int MI = MAX_ITEMS;
+  UItem items[MI];
+  int assignCnt, condCnt;
+  if (not parse(line, items, MI, assignCnt, condCnt))
+    return 0;
+  int n = 0;
+  if (maxCode < 1)
+    return 0;
+  code[n++] = (assignCnt << 4) | condCnt;
+  for (int i = 0; i < assignCnt + condCnt; i++)
+  {
+    if (n + 7 > maxCode)
+      return 0;
+    code[n++] = items[i].key | (items[i].op << 6);
+    float v100 = items[i].value * 100;
+    int iv = lroundf(v100);
+    if (fabsf(v100 - iv) < 1e-3 and iv > -32768 and iv < FLOAT_MARK)
+    {
+      code[n++] = iv & 0xff;
+      code[n++] = (iv >> 8) & 0xff;
+    }
+    else
+    {
+      code[n++] = FLOAT_MARK & 0xff;
+      code[n++] = FLOAT_MARK >> 8;
+      memcpy(&code[n], &items[i].value, 4);
+      n += 4;
+    }
+  }
+  return n;
+}
+
+
+bool USnippetCode::decode(const uint8_t * code, int codeCnt, char * text, int maxLen)
+{
+  const int MI = MAX_ITEMS;
+  UItem items[MI];
+  if (codeCnt < 1)
+    return false;
+  int assignCnt = code[0] >> 4;
+  int condCnt = code[0] & 0xf;
+  int n = 1;
+  for (int i = 0; i < assignCnt + condCnt; i++)
+  {
+    if (n + 3 > codeCnt)
+      return false;
+    items[i].key = code[n] & 0x3f;
+    items[i].op = code[n] >> 6;
+    if (items[i].key >= keyCnt or items[i].op > 2)
+      return false;
+    int16_t iv = int16_t(code[n + 1] | (code[n + 2] << 8));
+    n += 3;
+    if (iv == FLOAT_MARK)
+    {
+      if (n + 4 > codeCnt)
+        return false;
+      memcpy(&items[i].value, &code[n], 4);
+      n += 4;
+    }
+    else
+      items[i].value = iv / 100.0;
+  }
+  if (n != codeCnt)
+    return false;
+  format(items, assignCnt, condCnt, text, maxLen);
+  return true;
+}
+
+
+bool USnippetCode::normalize(const char * line, char * text, int maxLen)
+{
+  const int MI = MAX_ITEMS;
+  UItem items[MI];
+  int assignCnt, condCnt;
+  if (not parse(line, items, MI, assignCnt, condCnt))
+    return false;
+  format(items, assignCnt, condCnt, text, maxLen);
+  return true;
+}
+
+
+int USnippetCode::toBase64(const uint8_t * code, int codeCnt, char * text, int maxLen)
+{
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  int n = 0;
+  for (int i = 0; i < codeCnt and n + 4 < maxLen; i += 3)
+  {
+    uint32_t v = code[i] << 16;
+    if (i + 1 < codeCnt)
+      v |= code[i + 1] << 8;
+    if (i + 2 < codeCnt)
+      v |= code[i + 2];
+    text[n++] = b64[(v >> 18) & 0x3f];
+    text[n++] = b64[(v >> 12) & 0x3f];
+    text[n++] = i + 1 < codeCnt ? b64[(v >> 6) & 0x3f] : '=';
+    text[n++] = i + 2 < codeCnt ? b64[v & 0x3f] : '=';
+  }
+  if (maxLen > 0)
+    text[n] = '\0';
+  return n;
+}
+
+
+/**
+ * Is this a repeat start line, 'repeat=N [: conditions]'
+ * \param cond is set to the conditions (or empty) */
+static bool isRepeat(const char * line, int & count, const char *& cond)
+{
+  while (*line == ' ')
+    line++;
+  if (strncmp(line, "repeat", 6) != 0)
+    return false;
+  const char * p = line + 6;
+  while (*p == ' ')
+    p++;
+  if (*p != '=')
+    return false;
+  count = strtol(p + 1, NULL, 10);
+  cond = strchr(p, ':');
+  if (cond == NULL)
+    cond = "";
+  else
+  {
+    cond++;
+    while (*cond == ' ')
+      cond++;
+  }
+  return true;
+}
+
+static bool isEnd(const char * line)
+{
+  while (*line == ' ')
+    line++;
+  if (strncmp(line, "end", 3) != 0)
+    return false;
+  line += 3;
+  while (*line == ' ')
+    line++;
+  return *line == '\0';
+}
+
+
+int USnippetCode::expand(const char * const * in, int inCnt, char ** out, int maxOut,
+                         int maxLen, int & label, bool unroll)
+{
+  int n = 0;
+  bool cut = false;
+  for (int i = 0; i < inCnt and not cut; i++)
+  {
+    int count;
+    const char * cond;
+    if (not isRepeat(in[i], count, cond))
+    {
+      if (isEnd(in[i]))
+      {
+        printf("# USnippetCode::expand: 'end' without 'repeat' (line %d)\n", i + 1);
+        return -1;
+      }
+      cut = n >= maxOut;
+      if (not cut)
+        snprintf(out[n++], maxLen, "%s", in[i]);
+      continue;
+    }
+    // find end of block
+    int end = i + 1;
+    while (end < inCnt and not isEnd(in[end]))
+    {
+      int c;
+      const char * cd;
+      if (isRepeat(in[end], c, cd))
+      {
+        printf("# USnippetCode::expand: nested repeat (line %d)\n", end + 1);
+        return -1;
+      }
+      end++;
+    }
+    if (end >= inCnt or count < 1)
+    {
+      printf("# USnippetCode::expand: repeat without 'end' or count < 1 (line %d)\n", i + 1);
+      return -1;
+    }
+    int blockCnt = end - i - 1;
+    if (unroll and cond[0] == '\0')
+    {
+      cut = n + count * blockCnt > maxOut;
+      for (int r = 0; r < count; r++)
+      {
+        for (int j = i + 1; j < end and n < maxOut; j++)
+          snprintf(out[n++], maxLen, "%s", in[j]);
+      }
+    }
+    else if (n + blockCnt + 2 <= maxOut)
+    {
+      snprintf(out[n++], maxLen, "label=%d", label);
+      for (int j = i + 1; j < end; j++)
+        snprintf(out[n++], maxLen, "%s", in[j]);
+      if (cond[0] != '\0')
+        snprintf(out[n++], maxLen, "goto=%d: count=%d, %s", label, count - 1, cond);
+      else
+        snprintf(out[n++], maxLen, "goto=%d: count=%d", label, count - 1);
+      label++;
+    }
+    else
+      cut = true;
+    i = end;
+  }
+  if (cut)
+    printf("# USnippetCode::expand: more than %d lines, snippet is cut\n", maxOut);
+  return n;
+}
@@ -0,0 +1,79 @@
+#ifndef USNIPPETCODE_H
+#define USNIPPETCODE_H
+
+#include <stdint.h>
+
+/**
+ * Compact binary form of mission snippet lines, e.g.
+ *   "vel=0.3, acc=3.0, edgel=0,white=1: time=3, lv<1"   (46 characters)
+ * is 19 bytes, 28 characters as base64 on the text link to the bridge.
+ *
+ * Encoding of one line:
+ *   byte 0      number of assignments (high 4 bits) and conditions (low 4 bits)
+ *   per item    byte: key index (low 6 bits), operator (high 2 bits: 0 '=', 1 '<', 2 '>')
+ *               int16 (little endian) value * 100, or 0x7fff followed by a float
+ * Keys not in the key table, or more than 15 assignments or 15 conditions,
+ * can not be compiled; such lines are sent as text.
+ * The text form (decode) is kept for debugging and to verify a compiled line. */
+class USnippetCode
+{
+public:
+  /// longest compiled line
+  static const int MAX_CODE = 1 + 30 * 7;
+  /// most items (assignments and conditions) in a line
+  static const int MAX_ITEMS = 30;
+  /** one 'key op value' item of a line, op is 0 '=', 1 '<', 2 '>' */
+  class UItem
+  {
+  public:
+    int key;
+    int op;
+    float value;
+  };
+  /** index of key, -1 if not known */
+  static int key(const char * name);
+  /**
+   * Split line into items, assignments first
+   * \returns false on syntax error or unknown key */
+  static bool parse(const char * line, UItem * items, int maxItems, int & assignCnt, int & condCnt);
+  /** items as text, e.g. "vel=0.3,acc=3:time=3,lv<1" */
+  static void format(UItem * items, int assignCnt, int condCnt, char * text, int maxLen);
+  /**
+   * Compile a snippet line
+   * \returns number of bytes in code, 0 if the line can not be compiled */
+  static int compile(const char * line, uint8_t * code, int maxCode);
+  /**
+   * Text form of a compiled line, e.g. "vel=0.3,acc=3:time=3,lv<1"
+   * \returns false if the code is invalid */
+  static bool decode(const uint8_t * code, int codeCnt, char * text, int maxLen);
+  /**
+   * Same line in the form of decode() (no spaces, shortest numbers),
+   * for comparison
+   * \returns false if the line has an unknown key or a syntax error */
+  static bool normalize(const char * line, char * text, int maxLen);
+  /**
+   * Expand repeat blocks in snippet lines:
+   *   repeat=N [: conditions]
+   *   ... lines ...
+   *   end
+   * The block becomes REGBOT label and goto lines, so N passes take the
+   * block lines plus 2:
+   *   label=K
+   *   ... lines ...
+   *   goto=K: count=N-1 [, conditions]
+   * The conditions are added to the goto line, so the repeat can end
+   * on a sensor (e.g. 'repeat=5: ir2<0.3'). With 'unroll' a block without
+   * conditions is written N times instead. Blocks can not be nested.
+   * Lines without a repeat block are copied as they are.
+   * \param label is the label to use for the next block, and is advanced,
+   *        labels must be unique in the REGBOT mission
+   * \returns number of lines in out, -1 on error (printed) */
+  static int expand(const char * const * in, int inCnt, char ** out, int maxOut,
+                    int maxLen, int & label, bool unroll = false);
+  /**
+   * base64 of code, zero terminated
+   * \returns number of characters */
+  static int toBase64(const uint8_t * code, int codeCnt, char * text, int maxLen);
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usnippetlink.h"
+#include "usnippetcode.h"
+#include "umissionio.h"
+#include "umetrics.h"
+#include "utiming.h"
+
+using namespace std;
+
+/// runtime metrics
+static UHistogram * ackMetric = UMetrics::histogram("snippet.ack_us");
+static UCounter * ackTimeoutMetric = UMetrics::counter("snippet.ack_timeouts");
+static UCounter * skippedMetric = UMetrics::counter("snippet.lines_skipped");
+static UCounter * binaryMetric = UMetrics::counter("snippet.lines_binary");
+
+
+USnippetLink::USnippetLink(UMissionIO & missionIo)
+  : io(missionIo)
+{
+  batch.reserve(4000);
+  binary = getenv("MISSION_SNIPPET_BINARY") != NULL;
+}
+
+
+bool USnippetLink::addBinary(int thread, int line, const char * text)
+{
+  uint8_t code[USnippetCode::MAX_CODE];
+  int n = USnippetCode::compile(text, code, USnippetCode::MAX_CODE);
+  if (n == 0)
+    return false;
+  // the text form of the code must be the line
+  const int MSL = 200;
+  char s[MSL], d[MSL];
+  if (not USnippetCode::decode(code, n, d, MSL) or
+      not USnippetCode::normalize(text, s, MSL) or strcmp(s, d) != 0)
+    return false;
+  char b64[MSL];
+  USnippetCode::toBase64(code, n, b64, MSL);
+  snprintf(s, MSL, "<modb %d %d %s\n", thread, line, b64);
+  batch += s;
+  binaryMetric->add();
+  return true;
+}
+
+
+int USnippetLink::upload(int thread, char ** lines, int lineCnt)
+{
+  TIMING_SCOPE("snippet/upload");
+  const int MSL = 30;
+  char s[MSL];
+  int n = 0;
+  vector<string> & loaded = shadow[thread];
+  batch.clear();
+  for (int i = 0; i < lineCnt; i++)
+  {
+    if (lines[i][0] == '\0')
+      // an empty line will end code snippet too
+      break;
+    if (i < int(loaded.size()) and loaded[i] == lines[i])
+    { // in place already
+      skippedMetric->add();
+      continue;
+    }
+    if (not binary or not addBinary(thread, i + 1, lines[i]))
+    {
+      snprintf(s, MSL, "<mod %d %d ", thread, i + 1);
+      batch += s;
+      batch += lines[i];
+      batch += '\n';
+    }
+    if (i >= int(loaded.size()))
+      loaded.resize(i + 1);
+    loaded[i] = lines[i];
+    n++;
+  }
+  lastThread = thread;
+  // clear an old acknowledge, then ask for a new one
+  io.clearEvent(ACK_EVENT);
+  snprintf(s, MSL, "<event=%d\n", ACK_EVENT);
+  batch += s;
+  io.send(batch.c_str());
+  return n;
+}
+
+
+bool USnippetLink::waitAck(int timeoutUs)
+{
+  double t0 = io.now();
+  if (ackResult(io.waitForEvent(ACK_EVENT, timeoutUs * 1e-6), t0))
+    return true;
+  printf("# USnippetLink::waitAck: no acknowledge (event %d) in %d ms, activating anyway\n",
+         ACK_EVENT, timeoutUs / 1000);
+  return false;
+}
+
+
+bool USnippetLink::ackResult(bool received, double t0)
+{
+  if (received)
+  {
+    ackMetric->record(long((io.now() - t0) * 1e6));
+    return true;
+  }
+  ackTimeoutMetric->add();
+  // some lines may be missing
+  shadow.erase(lastThread);
+  return false;
+}
+
+
+void USnippetLink::activate(int startEvent)
+{
+  const int MSL = 30;
+  char s[MSL];
+  snprintf(s, MSL, "<event=%d\n", startEvent);
+  io.send(s);
+}
+
+
+void USnippetLink::clear()
+{
+  shadow.clear();
+}
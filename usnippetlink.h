@@ -0,0 +1,84 @@
+#ifndef USNIPPETLINK_H
+#define USNIPPETLINK_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+class UMissionIO;
+
+/**
+ * Upload of mission snippets to the REGBOT threads 100 and 101.
+ * All '<mod' lines of a snippet are sent as one message (one write to the
+ * bridge), followed by '<event=29'. The REGBOT handles commands in order
+ * and reports every event it sets, so when event 29 comes back, all the lines
+ * are in place, and the snippet can be activated - no fixed sleep.
+ * If the acknowledge is lost, the activation is sent after a timeout.
+ *
+ * A shadow of the lines loaded in each REGBOT thread is kept, and only
+ * lines that differ are sent - repeated servo lines and stair steps
+ * are most often in place already.
+ *
+ * With the environment variable MISSION_SNIPPET_BINARY set, lines are sent
+ * in the compact binary form (usnippetcode.h) as '<modb thread line base64'
+ * (needs REGBOT firmware that knows '<modb'); lines that do not compile
+ * are sent as text.
+ *
+ * REGBOT events used by the missions:
+ *   0       stop
+ *   1..10   segment completion (Mission.cpp), also starts the next preloaded segment
+ *   11      start of the first preloaded segment (Mission.cpp)
+ *   25      look-ahead leg started
+ *   29      upload acknowledge
+ *   30, 31  start thread 100 or 101
+ *   33      start (button) */
+class USnippetLink
+{
+public:
+  /// REGBOT event set after the '<mod' lines, to acknowledge the upload
+  static const int ACK_EVENT = 29;
+
+  USnippetLink(UMissionIO & missionIo);
+  /**
+   * Send the lines to this REGBOT thread as one message,
+   * lines already in the thread are skipped.
+   * An empty line ends the snippet.
+   * \returns number of lines sent */
+  int upload(int thread, char ** lines, int lineCnt);
+  /**
+   * Wait for the acknowledge of the last upload
+   * \returns false if not received within timeout */
+  bool waitAck(int timeoutUs = 100000);
+  /**
+   * Use the result of a wait for the acknowledge (event ACK_EVENT) done
+   * elsewhere, e.g. by a mission task that must not block
+   * \param received is true if the acknowledge came in time
+   * \param t0 is the time (io.now()) the wait started
+   * \returns received */
+  bool ackResult(bool received, double t0);
+  /** start the uploaded thread (and stop the other) */
+  void activate(int startEvent);
+  /** send lines in binary form */
+  void setBinary(bool useBinary) { binary = useBinary; }
+  bool isBinary() { return binary; }
+  /**
+   * Forget the shadow of all threads (REGBOT mission cleared),
+   * next uploads are sent in full */
+  void clear();
+
+private:
+  /**
+   * add line in binary form to batch
+   * \returns false if it can not be compiled */
+  bool addBinary(int thread, int line, const char * text);
+  UMissionIO & io;
+  /// message with all lines
+  std::string batch;
+  /// lines loaded in each REGBOT thread, as far as known
+  std::map<int, std::vector<std::string> > shadow;
+  /// thread of last upload
+  int lastThread = -1;
+  bool binary = false;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "usnippetopt.h"
+#include "usnippetcode.h"
+#include "umetrics.h"
+
+/// runtime metrics
+static UCounter * savedMetric = UMetrics::counter("snippet.opt_saved_ms");
+static UCounter * removedMetric = UMetrics::counter("snippet.opt_lines_removed");
+
+/**
+ * A parsed snippet line */
+class UOptLine
+{
+public:
+  bool parsed;
+  bool keep;
+  bool removed = false;
+  bool changed = false;
+  USnippetCode::UItem items[USnippetCode::MAX_ITEMS];
+  int assignCnt = 0;
+  int condCnt = 0;
+  /** index of item with this key in assignments (cond=false) or conditions, -1 if none */
+  int find(int key, bool cond)
+  {
+    int first = cond ? assignCnt : 0;
+    int last = cond ? assignCnt + condCnt : assignCnt;
+    for (int i = first; i < last; i++)
+    {
+      if (items[i].key == key)
+        return i;
+    }
+    return -1;
+  }
+  /** is 'vel=0: time=T' */
+  bool isStop(int vel, int time)
+  {
+    return parsed and not keep and assignCnt == 1 and condCnt == 1 and
+           items[0].key == vel and items[0].value == 0 and
+           items[1].key == time and items[1].op == 0;
+  }
+  /** has the only condition 'key=value' */
+  bool endsOnlyOn(int key)
+  {
+    return condCnt == 1 and items[assignCnt].key == key and items[assignCnt].op == 0;
+  }
+};
+
+
+USnippetOptimiser::USnippetOptimiser()
+{
+  enabled = getenv("MISSION_SNIPPET_OPT") != NULL;
+}
+
+
+int USnippetOptimiser::optimise(char ** lines, int lineCnt, int maxLen, float & saved)
+{
+  saved = 0;
+  if (lineCnt <= 0)
+    return lineCnt;
+  const int ML = 60;
+  UOptLine ol[ML];
+  int n = lineCnt < ML ? lineCnt : ML;
+  const int kVel = USnippetCode::key("vel");
+  const int kAcc = USnippetCode::key("acc");
+  const int kTime = USnippetCode::key("time");
+  const int kDist = USnippetCode::key("dist");
+  const int kTurn = USnippetCode::key("turn");
+  const int kEvent = USnippetCode::key("event");
+  const int kServo = USnippetCode::key("servo");
+  for (int i = 0; i < n; i++)
+  {
+    int len = strlen(lines[i]);
+    while (len > 0 and lines[i][len - 1] == ' ')
+      len--;
+    ol[i].keep = len > 0 and lines[i][len - 1] == '!';
+    if (ol[i].keep)
+      // not for the REGBOT
+      lines[i][len - 1] = '\0';
+    ol[i].parsed = USnippetCode::parse(lines[i], ol[i].items, USnippetCode::MAX_ITEMS,
+                                       ol[i].assignCnt, ol[i].condCnt);
+    if (ol[i].find(kEvent, false) >= 0 or ol[i].find(kEvent, true) >= 0)
+      ol[i].parsed = false;
+  }
+  if (not enabled)
+    return lineCnt;
+  // velocity and acceleration at the start of each line
+  float vel = 0;
+  float acc = defaultAcc;
+  int prev = -1;
+  for (int i = 0; i < n; i++)
+  {
+    UOptLine & l = ol[i];
+    int vi = l.parsed ? l.find(kVel, false) : -1;
+    int ai = l.parsed ? l.find(kAcc, false) : -1;
+    if (ai >= 0 and l.items[ai].value > 0)
+      acc = l.items[ai].value;
+    if (l.isStop(kVel, kTime) and prev >= 0 and i + 1 < n)
+    {
+      UOptLine & p = ol[prev];
+      UOptLine & next = ol[i + 1];
+      float t = l.items[1].value;
+      int nvi = next.parsed ? next.find(kVel, false) : -1;
+      if (p.isStop(kVel, kTime))
+      { // two stops in a row
+        p.items[1].value += t;
+        p.changed = true;
+        l.removed = true;
+        continue;
+      }
+      bool afterServo = p.parsed and p.find(kServo, false) >= 0;
+      bool afterTurn = p.parsed and p.find(kTurn, true) >= 0;
+      if (nvi >= 0 and p.parsed and not afterServo)
+      {
+        float vNext = next.items[nvi].value;
+        bool sameDir = vel * vNext > 0;
+        if (t <= maxPause or (afterTurn and sameDir and t <= maxBlend))
+        { // no stop: save the pause, and the braking and speeding up
+          // that is more than a direct change of velocity
+          saved += t + (fabsf(vel) + fabsf(vNext) - fabsf(vNext - vel)) / acc;
+          l.removed = true;
+          continue;
+        }
+      }
+    }
+    else if (prev >= 0 and l.parsed and not l.keep and ol[prev].parsed and not ol[prev].keep and
+             l.assignCnt > 0 and l.assignCnt == ol[prev].assignCnt and
+             ((l.endsOnlyOn(kDist) and ol[prev].endsOnlyOn(kDist)) or
+              (l.endsOnlyOn(kTime) and ol[prev].endsOnlyOn(kTime))))
+    { // same assignments (same order), add the distances or times
+      UOptLine & p = ol[prev];
+      bool same = true;
+      for (int a = 0; a < l.assignCnt and same; a++)
+        same = l.items[a].key == p.items[a].key and l.items[a].value == p.items[a].value;
+      if (same)
+      {
+        p.items[p.assignCnt].value += l.items[l.assignCnt].value;
+        p.changed = true;
+        l.removed = true;
+        continue;
+      }
+    }
+    if (vi >= 0)
+      vel = l.items[vi].value;
+    prev = i;
+  }
+  // write back
+  int m = 0;
+  for (int i = 0; i < lineCnt; i++)
+  {
+    if (i < n and ol[i].removed)
+      continue;
+    if (i < n and ol[i].changed)
+      USnippetCode::format(ol[i].items, ol[i].assignCnt, ol[i].condCnt, lines[m], maxLen);
+    else if (m != i)
+      snprintf(lines[m], maxLen, "%s", lines[i]);
+    m++;
+  }
+  totalSaved += saved;
+  linesRemoved += lineCnt - m;
+  savedMetric->add(long(saved * 1000));
+  removedMetric->add(lineCnt - m);
+  return m;
+}
@@ -0,0 +1,41 @@
+#ifndef USNIPPETOPT_H
+#define USNIPPETOPT_H
+
+/**
+ * Peephole optimiser for mission snippets, run on the lines before upload.
+ * It works line by line with the line before and after:
+ *   - short stops 'vel=0: time=T' (T <= maxPause) are removed, if the next
+ *     line sets a new velocity and the line before is not a servo command
+ *   - a stop between a turn and a move in the same direction is removed
+ *     if T <= maxBlend, so the turn blends into the move
+ *   - consecutive stops are merged into one
+ *   - consecutive moves with the same assignments that end on distance only
+ *     (or time only) are merged into one line
+ * A line ending with '!' is kept as it is (the '!' is removed).
+ * Lines with an event, or that can not be parsed, are never changed.
+ * The time saved is predicted from the velocities and accelerations. */
+class USnippetOptimiser
+{
+public:
+  /// longest stop removed [s]
+  float maxPause = 0.1;
+  /// longest stop removed between a turn and a move [s]
+  float maxBlend = 0.5;
+  /// acceleration if not set in the lines [m/s^2]
+  float defaultAcc = 1.0;
+  /// optimising is on, if off only the '!' marks are removed
+  bool enabled = false;
+  /**
+   * enabled if the environment variable MISSION_SNIPPET_OPT is set */
+  USnippetOptimiser();
+  /**
+   * Optimise lines in place
+   * \param saved is set to the predicted time saved [s]
+   * \returns new number of lines */
+  int optimise(char ** lines, int lineCnt, int maxLen, float & saved);
+  /** total over all snippets */
+  float totalSaved = 0;
+  int linesRemoved = 0;
+};
+
+#endif
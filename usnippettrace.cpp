@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "usnippettrace.h"
+#include "utracer.h"
+
+using namespace std;
+
+/// histogram bin limits [ms]
+static const double binLimit[USnippetTrace::BINS - 1] =
+    {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+static const char * phaseName[USnippetTrace::PHASES] =
+    {"upload", "activate", "motion", "run", "detect"};
+
+
+void USnippetTrace::UHist::add(double ms)
+{
+  int b = 0;
+  while (b < BINS - 1 and ms > binLimit[b])
+    b++;
+  cnt[b]++;
+  n++;
+  sum += ms;
+  if (ms > max)
+    max = ms;
+}
+
+
+int USnippetTrace::begin(int missionNumber, int missionState, const char * const * lines, int cnt, double t)
+{
+  lock_guard<mutex> guard(lock);
+  if (active)
+    finish(false);
+  active = true;
+  id = ++lastId;
+  mission = missionNumber;
+  state = missionState;
+  lineCnt = 0;
+  tFormat = t;
+  tSend = tActivate = tMotion = tDone = tLastPoll = -1;
+  // completion is the last event set by the snippet (not thread control 30..33)
+  doneEvent = -1;
+  for (int i = 0; i < cnt and lines[i][0] != '\0'; i++)
+  {
+    lineCnt++;
+    const char * p = strstr(lines[i], "event=");
+    if (p != NULL)
+    {
+      int n = atoi(p + 6);
+      if (n > 0 and n < 30)
+        doneEvent = n;
+    }
+  }
+  if (UTracer::enabled)
+  {
+    const int MSL = 100;
+    char s[MSL];
+    snprintf(s, MSL, "mission %d state %d, %d lines, ends on event %d", mission, state, lineCnt, doneEvent);
+    UTracer::asyncBegin("snippet", "snippet", id, s);
+  }
+  return id;
+}
+
+
+void USnippetTrace::sent(double t)
+{
+  lock_guard<mutex> guard(lock);
+  tSend = t;
+}
+
+
+void USnippetTrace::activated(double t)
+{
+  lock_guard<mutex> guard(lock);
+  tActivate = t;
+}
+
+
+void USnippetTrace::velocity(float v, double t)
+{
+  if (fabsf(v) > 0.005)
+  {
+    lock_guard<mutex> guard(lock);
+    if (waitingForMotion())
+      tMotion = t;
+  }
+}
+
+
+void USnippetTrace::event(int n, bool isSet, double t)
+{
+  lock_guard<mutex> guard(lock);
+  if (not active or n != doneEvent or tActivate < 0)
+    return;
+  if (isSet)
+  { // a set event right after activation is a left-over from an earlier
+    // snippet (the missions clear events this way), not the completion
+    if (tLastPoll < 0 and tMotion < 0)
+      return;
+    tDone = t;
+    finish(true);
+  }
+  else
+    tLastPoll = t;
+}
+
+
+void USnippetTrace::finish(bool completed)
+{
+  active = false;
+  if (not completed)
+    replaced++;
+  UTracer::asyncEnd("snippet", "snippet", id, completed ? "completed" : "replaced");
+  // latencies [ms], negative if not available
+  double ms[PHASES];
+  ms[UPLOAD] = tSend >= 0 ? (tSend - tFormat) * 1000 : -1;
+  ms[ACTIVATE] = tActivate >= 0 and tSend >= 0 ? (tActivate - tSend) * 1000 : -1;
+  ms[MOTION] = tMotion >= 0 ? (tMotion - tActivate) * 1000 : -1;
+  ms[RUN] = completed ? (tDone - tActivate) * 1000 : -1;
+  ms[DETECT] = completed and tLastPoll >= 0 ? (tDone - tLastPoll) * 1000 : -1;
+  UHist * h = hist[make_pair(mission, state)];
+  for (int i = 0; i < PHASES; i++)
+  {
+    if (ms[i] >= 0)
+      h[i].add(ms[i]);
+  }
+  if (logFile != NULL)
+    fprintf(logFile, "%% snippet %d mission %d state %d lines %d event %d format %.4f "
+                     "upload %.2f activate %.2f motion %.2f run %.2f detect %.2f%s\n",
+            id, mission, state, lineCnt, doneEvent, tFormat,
+            ms[UPLOAD], ms[ACTIVATE], ms[MOTION], ms[RUN], ms[DETECT],
+            completed ? "" : " replaced");
+}
+
+
+void USnippetTrace::setLog(FILE * f)
+{
+  lock_guard<mutex> guard(lock);
+  logFile = f;
+  if (logFile != NULL)
+  {
+    fprintf(logFile, "%% '%% snippet' lines: trace ID, mission, state, lines, completion event,\n");
+    fprintf(logFile, "%%   format time [sec] and latencies [ms] (-1 if not seen): upload (format to sent),\n");
+    fprintf(logFile, "%%   activate (sent to activated), motion (activated to first velocity),\n");
+    fprintf(logFile, "%%   run (activated to completion event), detect (event poll interval)\n");
+  }
+}
+
+
+void USnippetTrace::printStatus()
+{
+  lock_guard<mutex> guard(lock);
+  printf("# ------- Snippet latency (ms) ----------\n");
+  printf("# %d snippets, %d replaced before completion\n", lastId, replaced);
+  printf("# mission state phase     n    mean     max |");
+  for (int b = 0; b < BINS - 1; b++)
+    printf(" <%-4g", binLimit[b]);
+  printf(" more\n");
+  for (auto & msh : hist)
+  {
+    for (int i = 0; i < PHASES; i++)
+    {
+      UHist & h = msh.second[i];
+      if (h.n == 0)
+        continue;
+      printf("# %7d %5d %-8s %4d %7.1f %7.1f |", msh.first.first, msh.first.second,
+             phaseName[i], h.n, h.sum / h.n, h.max);
+      for (int b = 0; b < BINS; b++)
+        printf(" %5d", h.cnt[b]);
+      printf("\n");
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef USNIPPETTRACE_H
+#define USNIPPETTRACE_H
+
+#include <stdio.h>
+#include <mutex>
+#include <map>
+#include <utility>
+
+/**
+ * Round trip tracing of mission snippets.
+ * Every snippet sent by sendAndActivateSnippet() gets a trace ID and
+ * timestamps (io.now(), so replay gives the recorded times) at:
+ *   format   - sendAndActivateSnippet() is called
+ *   send     - all '<mod' lines are sent
+ *   activate - the '<event=30/31' activation is sent
+ *   motion   - first motor velocity after activation
+ *   complete - isEventSet() first reports the completion event
+ *              (the last 'event=N' in the snippet).
+ * Events are only seen when polled, so the last poll that did not see the
+ * completion event is saved too; the event arrived between the two.
+ * Latencies are collected in histograms for each mission state. */
+class USnippetTrace
+{
+public:
+  /// histogram bins [ms], last bin is above the last limit
+  static const int BINS = 13;
+  /// latencies in histograms
+  enum { UPLOAD, ACTIVATE, MOTION, RUN, DETECT, PHASES };
+  /**
+   * New snippet, formatting is starting.
+   * The previous snippet is ended (completed or replaced).
+   * \returns trace ID */
+  int begin(int mission, int state, const char * const * lines, int lineCnt, double t);
+  /** all lines sent */
+  void sent(double t);
+  /** activation event sent */
+  void activated(double t);
+  /** waiting for first motion */
+  bool waitingForMotion() { return active and tActivate > 0 and tMotion < 0; }
+  /** motor velocity sample */
+  void velocity(float v, double t);
+  /** result of an isEventSet() poll */
+  void event(int n, bool isSet, double t);
+  /** write a '% snippet' line for each finished snippet to this log (NULL to stop) */
+  void setLog(FILE * f);
+  /** print latency histograms per mission state */
+  void printStatus();
+
+private:
+  /** save the current snippet to log and histograms */
+  void finish(bool completed);
+
+  class UHist
+  {
+  public:
+    int cnt[BINS] = {0};
+    int n = 0;
+    double sum = 0;
+    double max = 0;
+    void add(double ms);
+  };
+  std::mutex lock;
+  FILE * logFile = NULL;
+  int lastId = 0;
+  // current snippet
+  bool active = false;
+  int id = 0;
+  int mission = 0;
+  int state = 0;
+  int lineCnt = 0;
+  /// completion event, -1 if none
+  int doneEvent = -1;
+  double tFormat = -1, tSend = -1, tActivate = -1, tMotion = -1, tDone = -1;
+  /// last poll of the completion event that was not set
+  double tLastPoll = -1;
+  /// histograms for (mission, state)
+  std::map<std::pair<int, int>, UHist[PHASES]> hist;
+  int replaced = 0;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef USPSCQUEUE_H
+#define USPSCQUEUE_H
+
+#include <atomic>
+
+/**
+ * Lock-free queue from one producer thread to one consumer thread.
+ * A ring of SIZE items (a power of two); head is written by the consumer
+ * only and tail by the producer only, so push and pop are a load and a
+ * store each, and never block. When the queue is full, push fails (the
+ * producer decides what to do, e.g. count a drop).
+ *
+ * Only one thread may push and only one (other) thread may pop. */
+template <class T, int SIZE>
+class USpscQueue
+{
+  static_assert(SIZE > 0 and (SIZE & (SIZE - 1)) == 0, "USpscQueue size must be a power of two");
+public:
+  /** add item (producer thread)
+   * \returns false if the queue is full */
+  bool push(const T & item)
+  {
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= unsigned(SIZE))
+      return false;
+    items[t & (SIZE - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+  /** take oldest item (consumer thread)
+   * \returns false if the queue is empty */
+  bool pop(T & item)
+  {
+    unsigned h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    item = items[h & (SIZE - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+  /** drop all items (consumer thread) */
+  void clear()
+  {
+    head.store(tail.load(std::memory_order_acquire), std::memory_order_release);
+  }
+  /** items in queue (approximate, if the other thread is active) */
+  int size() { return int(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)); }
+
+private:
+  T items[SIZE];
+  // on separate cache lines, written by different threads
+  alignas(64) std::atomic<unsigned> head{0};
+  alignas(64) std::atomic<unsigned> tail{0};
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <chrono>
+
+#include "ustatemachine.h"
+
+using namespace std;
+
+
+UStateMachine::UStateMachine(const char * machineName, function<double ()> clock)
+{
+  name = machineName;
+  this->clock = clock;
+}
+
+
+UStateMachine::UState & UStateMachine::add(int id, const char * name)
+{
+  UState * st = find(id);
+  if (st != nullptr)
+    return *st;
+  states.emplace_back();
+  UState & ns = states.back();
+  ns.id = id;
+  ns.name = name;
+  return ns;
+}
+
+
+UStateMachine::UState * UStateMachine::find(int id)
+{
+  for (UState & st : states)
+  {
+    if (st.id == id)
+      return &st;
+  }
+  return nullptr;
+}
+
+
+double UStateMachine::now()
+{
+  if (clock)
+    return clock();
+  chrono::duration<double> t = chrono::steady_clock::now().time_since_epoch();
+  return t.count();
+}
+
+
+void UStateMachine::enter(UState * st, double t)
+{
+  if (current >= 0)
+  {
+    UState & old = states[current];
+    old.time += t - enterTime;
+    if (old.exit)
+      old.exit();
+    if (changeHook)
+      changeHook(old.id, st->id);
+  }
+  current = st - &states[0];
+  enterTime = t;
+  st->visits++;
+  if (st->enter)
+    st->enter();
+}
+
+
+bool UStateMachine::tick(int & state)
+{
+  ticks++;
+  double t = now();
+  UState * st = find(state);
+  if (st == nullptr)
+  {
+    printf("# UStateMachine::tick: %s has no state %d\n", name, state);
+    return true;
+  }
+  if (current < 0 or states[current].id != state)
+    // first tick, or state set from outside
+    enter(st, t);
+  int steps = 0;
+  while (not st->final)
+  {
+    if (st->poll)
+      st->poll();
+    UState * next = nullptr;
+    for (UTransition & tr : st->transitions)
+    {
+      if (not tr.guard or tr.guard())
+      {
+        next = find(tr.to);
+        if (next == nullptr)
+        {
+          printf("# UStateMachine::tick: %s state %d to unknown state %d\n", name, st->id, tr.to);
+          return true;
+        }
+        break;
+      }
+    }
+    if (next == nullptr)
+      // stable
+      break;
+    if (++steps > MAX_STEPS)
+    {
+      printf("# UStateMachine::tick: %s more than %d transitions in one tick (in state %d)\n",
+             name, MAX_STEPS, st->id);
+      break;
+    }
+    transitionCnt++;
+    // the new state is visible (e.g. for snippet tracing) before enter
+    state = next->id;
+    enter(next, now());
+    st = next;
+  }
+  if (steps > maxChain)
+    maxChain = steps;
+  return st->final;
+}
+
+
+void UStateMachine::reset()
+{
+  for (UState & st : states)
+  {
+    st.visits = 0;
+    st.time = 0;
+  }
+  current = -1;
+  ticks = 0;
+  transitionCnt = 0;
+  maxChain = 0;
+}
+
+
+void UStateMachine::printStatus()
+{
+  printf("# ------- State machine %s ----------\n", name);
+  printf("# %d ticks, %d transitions, max %d in one tick\n", ticks, transitionCnt, maxChain);
+  double t = now();
+  for (UState & st : states)
+  {
+    if (st.visits == 0)
+      continue;
+    double time = st.time;
+    if (current >= 0 and &states[current] == &st)
+      time += t - enterTime;
+    printf("# %c %4d %-20s %3d visits, %8.3f sec\n",
+           current >= 0 and &states[current] == &st ? '*' : ' ',
+           st.id, st.name, st.visits, time);
+  }
+}
+
+
+void UStateMachine::logStats(FILE * f)
+{
+  if (f == NULL)
+    return;
+  double t = now();
+  for (UState & st : states)
+  {
+    if (st.visits == 0)
+      continue;
+    double time = st.time;
+    if (current >= 0 and &states[current] == &st)
+      time += t - enterTime;
+    fprintf(f, "%% state %s %d visits %d time %.3f\n", name, st.id, st.visits, time);
+  }
+}
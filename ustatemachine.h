@@ -0,0 +1,105 @@
+#ifndef USTATEMACHINE_H
+#define USTATEMACHINE_H
+
+#include <stdio.h>
+#include <functional>
+#include <vector>
+
+/**
+ * Table driven mission state machine.
+ * Each state has optional enter, poll and exit handlers and a list of
+ * guarded transitions (first guard that is true wins, no guard is always true).
+ * A tick polls the current state and follows transitions, repeatedly,
+ * until no guard is true, so a chain like 'event seen -> send next snippet
+ * -> wait' is done in one tick, not one state per mission loop.
+ * Time spent in each state is recorded.
+ *
+ * Use:
+ *   sm.add(10, "ramp").onEnter(sendRamp).to(11);
+ *   sm.add(11, "wait ramp").when([]{ return io.isEventSet(1); }, 12);
+ *   ...
+ *   finished = sm.tick(state);   // in missionN(int & state)
+ * */
+class UStateMachine
+{
+public:
+  typedef std::function<void ()> Action;
+  typedef std::function<bool ()> Guard;
+  /// no more than this many transitions in one tick (a loop in the table)
+  static const int MAX_STEPS = 25;
+
+  class UTransition
+  {
+  public:
+    Guard guard;
+    int to;
+  };
+
+  class UState
+  {
+  public:
+    int id;
+    const char * name;
+    Action enter;
+    Action poll;
+    Action exit;
+    std::vector<UTransition> transitions;
+    /// the machine is finished when this state is entered
+    bool final = false;
+    /// statistics
+    int visits = 0;
+    double time = 0;
+    // builder functions, return the state, so calls can be chained
+    UState & onEnter(Action a) { enter = a; return *this; }
+    UState & onPoll(Action a) { poll = a; return *this; }
+    UState & onExit(Action a) { exit = a; return *this; }
+    /** transition when guard is true */
+    UState & when(Guard g, int toState) { transitions.push_back({g, toState}); return *this; }
+    /** transition always (after enter and poll) */
+    UState & to(int toState) { transitions.push_back({nullptr, toState}); return *this; }
+    UState & isFinal() { final = true; return *this; }
+  };
+
+  /**
+   * \param machineName is used in prints and log
+   * \param clock is the time source [sec], e.g. io.now(), steady clock if empty */
+  UStateMachine(const char * machineName, std::function<double ()> clock = nullptr);
+  /** add a state (or get it if it exists) */
+  UState & add(int id, const char * name);
+  bool empty() { return states.empty(); }
+  /**
+   * Run the machine until stable.
+   * \param state is the current state, set to the new state at each
+   *              transition (before the enter handler is called).
+   *              A state set from outside (not the current) is entered.
+   * \returns true if a final (or unknown) state is reached */
+  bool tick(int & state);
+  /** function called at every transition (from, to) - e.g. for tracing */
+  void setChangeHook(std::function<void (int from, int to)> hook) { changeHook = hook; }
+  /** restart statistics and re-enter at next tick */
+  void reset();
+  /** time spent per state */
+  void printStatus();
+  /** '% state' line for every visited state */
+  void logStats(FILE * f);
+
+private:
+  UState * find(int id);
+  double now();
+  /** leave current state (if any) and enter this */
+  void enter(UState * st, double t);
+
+  const char * name;
+  std::function<double ()> clock;
+  std::function<void (int from, int to)> changeHook;
+  std::vector<UState> states;
+  /// current state, index into states, -1 if not entered
+  int current = -1;
+  double enterTime = 0;
+  int ticks = 0;
+  int transitionCnt = 0;
+  /// most transitions in one tick
+  int maxChain = 0;
+};
+
+#endif
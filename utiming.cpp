@@ -0,0 +1,172 @@
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "utiming.h"
+
+using namespace std;
+
+/**
+ * Samples from one thread */
+class UTimingRing
+{
+public:
+  UTimingRing()
+  {
+    for (int i = 0; i < UTiming::MAX_STAGES; i++)
+      cnt[i] = 0;
+  }
+  /// samples added to each stage
+  atomic<long> cnt[UTiming::MAX_STAGES];
+  float us[UTiming::MAX_STAGES][UTiming::RING_SIZE];
+  /// owned by a running thread
+  atomic<bool> inUse{true};
+};
+
+/// stage names
+static const char * stageNames[UTiming::MAX_STAGES];
+static atomic<int> stageCnt(0);
+/// rings of all threads, also from ended threads (reused by new threads)
+static vector<UTimingRing *> rings;
+static mutex ringLock;
+
+/**
+ * Ring of the calling thread, released when the thread ends */
+class UTimingThread
+{
+public:
+  ~UTimingThread()
+  {
+    if (ring != NULL)
+      ring->inUse = false;
+  }
+  UTimingRing * get()
+  {
+    if (ring == NULL)
+    {
+      lock_guard<mutex> guard(ringLock);
+      for (UTimingRing * r : rings)
+      {
+        bool free = false;
+        if (r->inUse.compare_exchange_strong(free, true))
+        {
+          ring = r;
+          return ring;
+        }
+      }
+      ring = new UTimingRing();
+      rings.push_back(ring);
+    }
+    return ring;
+  }
+private:
+  UTimingRing * ring = NULL;
+};
+
+static thread_local UTimingThread timingThread;
+
+
+int UTiming::stage(const char * name)
+{
+  lock_guard<mutex> guard(ringLock);
+  int n = stageCnt;
+  for (int i = 0; i < n; i++)
+  {
+    if (strcmp(stageNames[i], name) == 0)
+      return i;
+  }
+  if (n >= MAX_STAGES)
+  {
+    printf("# UTiming::stage: too many stages, '%s' not timed\n", name);
+    return -1;
+  }
+  stageNames[n] = name;
+  stageCnt = n + 1;
+  return n;
+}
+
+
+const char * UTiming::stageName(int stage)
+{
+  if (stage < 0 or stage >= stageCnt)
+    return "unknown";
+  return stageNames[stage];
+}
+
+
+void UTiming::add(int stage, float us)
+{
+  if (stage < 0)
+    return;
+  UTimingRing * r = timingThread.get();
+  long n = r->cnt[stage].load(memory_order_relaxed);
+  r->us[stage][n % RING_SIZE] = us;
+  r->cnt[stage].store(n + 1, memory_order_release);
+}
+
+
+int UTiming::getStats(UStats * stats, int maxCnt)
+{
+  vector<float> v;
+  int cnt = 0;
+  lock_guard<mutex> guard(ringLock);
+  int n = stageCnt;
+  for (int s = 0; s < n and cnt < maxCnt; s++)
+  {
+    UStats & st = stats[cnt];
+    st.count = 0;
+    v.clear();
+    for (UTimingRing * r : rings)
+    { // samples may be overwritten while copied, fine for statistics
+      long c = r->cnt[s].load(memory_order_acquire);
+      st.count += c;
+      for (long i = max(0L, c - RING_SIZE); i < c; i++)
+        v.push_back(r->us[s][i % RING_SIZE]);
+    }
+    if (v.empty())
+      continue;
+    sort(v.begin(), v.end());
+    double sum = 0;
+    for (float t : v)
+      sum += t;
+    st.name = stageNames[s];
+    st.n = v.size();
+    st.mean = sum / v.size() / 1000;
+    st.p50 = v[v.size() / 2] / 1000;
+    st.p95 = v[min(v.size() - 1, v.size() * 95 / 100)] / 1000;
+    st.max = v.back() / 1000;
+    cnt++;
+  }
+  return cnt;
+}
+
+
+void UTiming::printStatus()
+{
+  printf("# ------- Timing (ms, recent samples) ----------\n");
+#ifdef NO_TIMING
+  printf("# timing is compiled out (NO_TIMING)\n");
+#else
+  UStats stats[MAX_STAGES];
+  int n = getStats(stats, MAX_STAGES);
+  if (n == 0)
+    printf("# no samples yet\n");
+  for (int i = 0; i < n; i++)
+    printf("# %-22s %7ld calls, mean %8.2f, p50 %8.2f, p95 %8.2f, max %8.2f\n",
+           stats[i].name, stats[i].count, stats[i].mean, stats[i].p50, stats[i].p95, stats[i].max);
+#endif
+}
+
+
+void UTiming::logStats(FILE * f)
+{
+  if (f == NULL)
+    return;
+  UStats stats[MAX_STAGES];
+  int n = getStats(stats, MAX_STAGES);
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%% timing %s calls %ld mean %.3f p50 %.3f p95 %.3f max %.3f ms\n",
+            stats[i].name, stats[i].count, stats[i].mean, stats[i].p50, stats[i].p95, stats[i].max);
+}
@@ -0,0 +1,85 @@
+#ifndef UTIMING_H
+#define UTIMING_H
+
+#include <stdio.h>
+#include <chrono>
+
+#include "utracer.h"
+
+/**
+ * Low overhead timing of processing stages (capture, vision steps ...).
+ * Put TIMING_SCOPE("stage") first in a block to time the rest of the block,
+ * names must be without spaces, e.g. "hough/medianBlur".
+ * Each thread writes its samples to its own ring buffer (no locks),
+ * statistics are over the most recent samples from all threads.
+ * When tracing (utracer.h), every timed block is also a span in the trace.
+ * Define NO_TIMING when compiling to remove all timers. */
+class UTiming
+{
+public:
+  static const int MAX_STAGES = 32;
+  /// samples kept per stage for each thread
+  static const int RING_SIZE = 256;
+  /**
+   * Statistics for one stage, times in ms */
+  class UStats
+  {
+  public:
+    const char * name;
+    /// samples since start, and samples used in statistics
+    long count;
+    int n;
+    float mean, p50, p95, max;
+  };
+  /**
+   * Index of stage with this name, the stage is created
+   * if not there already. 'name' must be a constant string. */
+  static int stage(const char * name);
+  /** name of stage */
+  static const char * stageName(int stage);
+  /** add a sample [us] from the calling thread */
+  static void add(int stage, float us);
+  /**
+   * Get statistics for all stages with samples
+   * \returns number of stages in 'stats' */
+  static int getStats(UStats * stats, int maxCnt);
+  /** print statistics to console */
+  static void printStatus();
+  /** write statistics to a logfile as '% timing' lines */
+  static void logStats(FILE * f);
+};
+
+/**
+ * Time from construction to destruction, added to a stage */
+class UTimer
+{
+public:
+  UTimer(int stageIndex)
+  {
+    stage = stageIndex;
+    t0 = std::chrono::steady_clock::now();
+  }
+  ~UTimer()
+  {
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    std::chrono::duration<float, std::micro> dt = t1 - t0;
+    UTiming::add(stage, dt.count());
+    if (UTracer::enabled)
+      UTracer::complete(UTiming::stageName(stage), "timing", t0, t1);
+  }
+private:
+  int stage;
+  std::chrono::steady_clock::time_point t0;
+};
+
+#ifdef NO_TIMING
+#define TIMING_SCOPE(name)
+#else
+#define TIMING_JOIN2(a, b) a##b
+#define TIMING_JOIN(a, b) TIMING_JOIN2(a, b)
+#define TIMING_SCOPE(name) \
+  static const int TIMING_JOIN(timingStage, __LINE__) = UTiming::stage(name); \
+  UTimer TIMING_JOIN(timer, __LINE__)(TIMING_JOIN(timingStage, __LINE__))
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+
+#include "utracer.h"
+
+using namespace std;
+
+atomic<bool> UTracer::enabled(false);
+
+static mutex traceLock;
+static FILE * traceFile = NULL;
+static chrono::steady_clock::time_point traceStart;
+/// track numbers, mission states have their own
+static const int stateTrack = 1;
+static atomic<int> lastTrack(stateTrack);
+static thread_local int track = 0;
+/// current mission state span
+static int stateMission = -1;
+static int stateState = -1;
+static chrono::steady_clock::time_point stateStart;
+
+/** start tracing if MISSION_TRACE is set */
+class UTracerAutoStart
+{
+public:
+  UTracerAutoStart()
+  {
+    const char * name = getenv("MISSION_TRACE");
+    if (name != NULL)
+      UTracer::start(name);
+  }
+  ~UTracerAutoStart()
+  {
+    UTracer::stop();
+  }
+};
+
+static UTracerAutoStart autoStart;
+
+
+/** track of the calling thread */
+static int myTrack()
+{
+  if (track == 0)
+    track = ++lastTrack;
+  return track;
+}
+
+/** microseconds since trace start */
+static double traceUs(chrono::steady_clock::time_point t)
+{
+  chrono::duration<double, micro> dt = t - traceStart;
+  return dt.count();
+}
+
+/** as JSON string content */
+static string escape(const char * s)
+{
+  string e;
+  for (; *s != '\0'; s++)
+  {
+    if (*s == '"' or *s == '\\')
+      e += '\\';
+    if (*s == '\n')
+      e += "\\n";
+    else if ((unsigned char)*s >= ' ')
+      e += *s;
+  }
+  return e;
+}
+
+/** write one event (JSON object without braces) */
+static void writeEvent(const char * event)
+{
+  lock_guard<mutex> guard(traceLock);
+  if (traceFile != NULL)
+    fprintf(traceFile, "{%s},\n", event);
+}
+
+
+bool UTracer::start(const char * file)
+{
+  lock_guard<mutex> guard(traceLock);
+  if (traceFile != NULL)
+    return true;
+  traceFile = fopen(file, "w");
+  if (traceFile == NULL)
+  {
+    printf("# UTracer::start: failed to open '%s'\n", file);
+    return false;
+  }
+  traceStart = chrono::steady_clock::now();
+  fprintf(traceFile, "[\n");
+  fprintf(traceFile, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"mission\"}},\n",
+          getpid());
+  fprintf(traceFile, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"name\":\"mission state\"}},\n", getpid(), stateTrack);
+  printf("# UTracer: tracing to %s\n", file);
+  enabled = true;
+  return true;
+}
+
+
+void UTracer::stop()
+{
+  if (not enabled)
+    return;
+  // end the last state span
+  missionState(-1, -1);
+  enabled = false;
+  lock_guard<mutex> guard(traceLock);
+  if (traceFile != NULL)
+  { // last element without a comma
+    fprintf(traceFile, "{\"ph\":\"i\",\"name\":\"end\",\"pid\":%d,\"tid\":%d,\"ts\":%.1f,\"s\":\"g\"}\n]\n",
+            getpid(), stateTrack, traceUs(chrono::steady_clock::now()));
+    fclose(traceFile);
+    traceFile = NULL;
+  }
+}
+
+
+void UTracer::threadName(const char * name)
+{
+  if (not enabled)
+    return;
+  const int MSL = 200;
+  char s[MSL];
+  snprintf(s, MSL, "\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}",
+           getpid(), myTrack(), escape(name).c_str());
+  writeEvent(s);
+}
+
+
+void UTracer::complete(const char * name, const char * cat,
+                       chrono::steady_clock::time_point t0,
+                       chrono::steady_clock::time_point t1)
+{
+  if (not enabled)
+    return;
+  const int MSL = 200;
+  char s[MSL];
+  snprintf(s, MSL, "\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+           name, cat, getpid(), myTrack(), traceUs(t0), traceUs(t1) - traceUs(t0));
+  writeEvent(s);
+}
+
+
+void UTracer::instant(const char * name, const char * cat, const char * arg)
+{
+  if (not enabled)
+    return;
+  string e = "\"ph\":\"i\",\"s\":\"t\",\"name\":\"" + string(name) + "\",\"cat\":\"" + cat + "\"";
+  const int MSL = 100;
+  char s[MSL];
+  snprintf(s, MSL, ",\"pid\":%d,\"tid\":%d,\"ts\":%.1f", getpid(), myTrack(),
+           traceUs(chrono::steady_clock::now()));
+  e += s;
+  if (arg != nullptr)
+    e += ",\"args\":{\"msg\":\"" + escape(arg) + "\"}";
+  writeEvent(e.c_str());
+}
+
+
+/** async begin or end */
+static void asyncEvent(const char * ph, const char * name, const char * cat, int id, const char * arg)
+{
+  string e = "\"ph\":\"" + string(ph) + "\",\"name\":\"" + name + "\",\"cat\":\"" + cat + "\"";
+  const int MSL = 100;
+  char s[MSL];
+  snprintf(s, MSL, ",\"id\":%d,\"pid\":%d,\"tid\":%d,\"ts\":%.1f", id, getpid(), myTrack(),
+           traceUs(chrono::steady_clock::now()));
+  e += s;
+  if (arg != nullptr)
+    e += ",\"args\":{\"msg\":\"" + escape(arg) + "\"}";
+  writeEvent(e.c_str());
+}
+
+
+void UTracer::asyncBegin(const char * name, const char * cat, int id, const char * arg)
+{
+  if (enabled)
+    asyncEvent("b", name, cat, id, arg);
+}
+
+
+void UTracer::asyncEnd(const char * name, const char * cat, int id, const char * arg)
+{
+  if (enabled)
+    asyncEvent("e", name, cat, id, arg);
+}
+
+
+void UTracer::missionState(int mission, int state)
+{
+  if (not enabled)
+    return;
+  chrono::steady_clock::time_point t = chrono::steady_clock::now();
+  if (stateMission >= 0)
+  {
+    const int MSL = 250;
+    char s[MSL];
+    snprintf(s, MSL, "\"ph\":\"X\",\"name\":\"mission %d state %d\",\"cat\":\"state\",\"pid\":%d,"
+                     "\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+             stateMission, stateState, getpid(), stateTrack, traceUs(stateStart),
+             traceUs(t) - traceUs(stateStart));
+    writeEvent(s);
+  }
+  stateMission = mission;
+  stateState = state;
+  stateStart = t;
+}
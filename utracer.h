@@ -0,0 +1,66 @@
+#ifndef UTRACER_H
+#define UTRACER_H
+
+#include <atomic>
+#include <chrono>
+
+/**
+ * Timeline of a mission run as Chrome trace-event JSON
+ * (open in https://ui.perfetto.dev or chrome://tracing).
+ * Tracing starts if the environment variable MISSION_TRACE is set to a
+ * file name, else all calls return at once.
+ * Each thread is a track, named by threadName(), and mission states
+ * are spans on their own track. Everything timed with TIMING_SCOPE
+ * (see utiming.h) is a span on the thread that did the work. */
+class UTracer
+{
+public:
+  /** start tracing to this file (JSON) */
+  static bool start(const char * file);
+  /** stop tracing and close the file */
+  static void stop();
+  /** name the calling thread's track */
+  static void threadName(const char * name);
+  /**
+   * A finished span on the calling thread.
+   * 'name' and 'cat' must be without '"' and '\' */
+  static void complete(const char * name, const char * cat,
+                       std::chrono::steady_clock::time_point t0,
+                       std::chrono::steady_clock::time_point t1);
+  /** instant event on the calling thread, 'arg' is escaped */
+  static void instant(const char * name, const char * cat, const char * arg = nullptr);
+  /** start and end of an async slice, matched by 'id' */
+  static void asyncBegin(const char * name, const char * cat, int id, const char * arg = nullptr);
+  static void asyncEnd(const char * name, const char * cat, int id, const char * arg = nullptr);
+  /**
+   * Mission state changed - ends the span of the previous state
+   * on the mission state track */
+  static void missionState(int mission, int state);
+  /// tracing is active
+  static std::atomic<bool> enabled;
+};
+
+/**
+ * Span from construction to destruction */
+class UTraceScope
+{
+public:
+  UTraceScope(const char * spanName, const char * category)
+  {
+    name = spanName;
+    cat = category;
+    if (UTracer::enabled)
+      t0 = std::chrono::steady_clock::now();
+  }
+  ~UTraceScope()
+  {
+    if (UTracer::enabled)
+      UTracer::complete(name, cat, t0, std::chrono::steady_clock::now());
+  }
+private:
+  const char * name;
+  const char * cat;
+  std::chrono::steady_clock::time_point t0;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "uvision.h"
+#include "utiming.h"
+#include "uperfcount.h"
+#include "umetrics.h"
+
+using namespace std;
+using namespace cv;
+
+
+/// hardware counters for the ball detection, summed over all threads
+static UPerfCount houghPerf("houghcircles");
+
+/**
+ * Count the ball detection in the calling thread, and add it to houghPerf.
+ * houghcircles is called from more threads at once (vision_sweep workers,
+ * mission tasks), and a counter group counts one thread only. */
+class UHoughPerfScope
+{
+public:
+  UHoughPerfScope() { threadPerf.start(); }
+  ~UHoughPerfScope()
+  {
+    threadPerf.stop();
+    houghPerf.add(threadPerf);
+  }
+private:
+  static thread_local UPerfCount threadPerf;
+};
+
+thread_local UPerfCount UHoughPerfScope::threadPerf("houghcircles", false, false);
+/// runtime metrics for the ball detection
+static UHistogram * houghMetric = UMetrics::histogram("vision.hough_us");
+static UCounter * detectMetric = UMetrics::counter("vision.detections");
+
+//////////////////// START PERSONAL FUNCTIONS //////////////////
+
+//function that detects the circles in image
+vector<Vec3f> houghcircles(Mat img){
+  return houghcircles(img, UHoughParam());
+}
+
+//same, with detector parameters
+vector<Vec3f> houghcircles(Mat img, const UHoughParam & par){
+  TIMING_SCOPE("hough");
+  UHoughPerfScope perf;
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+
+  Mat gray; //image in gray scale
+  {
+    TIMING_SCOPE("hough/cvtColor");
+    cvtColor(img, gray, COLOR_RGB2GRAY); //imgCircles
+  }
+
+  Mat img_blur;
+  {
+    TIMING_SCOPE("hough/medianBlur");
+    medianBlur(gray, img_blur, par.blur); //blurr the image to make the calculations more efficient
+  }
+
+  Mat contrast;
+  {
+    TIMING_SCOPE("hough/convertTo");
+    img_blur.convertTo(contrast, -1, par.contrast, par.brightness); //increase the contrast
+  }
+
+  
+  vector<Vec3f> circles;
+  {
+    TIMING_SCOPE("hough/HoughCircles");
+    HoughCircles(contrast, circles, HOUGH_GRADIENT, 1, img.rows/par.minDistDiv,
+                 par.param1, par.param2, par.minRadius, par.maxRadius);
+  }
+  chrono::duration<double, micro> dt = chrono::steady_clock::now() - t0;
+  houghMetric->record(long(dt.count()));
+  if (not circles.empty())
+    detectMetric->add();
+
+  return circles;
+
+}
+
+// function that detects x coordinate and radius of the closest circle
+vector<double> closestBallcoord(vector<Vec3f> circles) {
+
+  //Set if ball is detected
+  bool ballDetected = false;
+  ballDetected = !circles.empty();
+
+  int closestCircleDetected = 0;
+
+  // Get radius and outline of circles detected - We are interested in the closest and largest circle
+  if (ballDetected == true)
+  {
+    for (size_t i = 0; i < circles.size(); i++)
+    {
+      Point center(cvRound(circles[i][0]), cvRound(circles[i][1]));
+      // center of the circle
+      double radius = cvRound(circles[i][2]);
+
+      // Check if the circle is the closest
+      if (radius > circles[closestCircleDetected][2])
+      {
+        closestCircleDetected = i;
+      }
+    }
+  }
+  vector<double> params;
+  params.push_back(circles[closestCircleDetected][0]); // x pixel coordinate
+  params.push_back(circles[closestCircleDetected][2]); // radius
+
+  return params;
+}
+
+
+//gives distance to given circle
+double PD2(double radius) {
+
+  //double FL = 3.04;
+  double pixelMM = 1.12 * 1e-3;
+  const double horiResMM = pixelMM* 3280;
+  const double FOVdegHalf = 31.1;
+  double FOVrad = FOVdegHalf * CV_PI / 180;
+  double FocalLength = horiResMM / (2 * tan(FOVrad));
+  double diameterDetectedBall = radius / 2;
+  //double diameterDetectedBall = radius*2;
+  diameterDetectedBall *= pixelMM;
+  double distance = (FocalLength * horiResMM) / diameterDetectedBall;
+  //double distance2Ball = (distance * pixelMM) / 10; 
+
+  //return distance2Ball; 
+  return distance;
+
+}
+
+
+//Used to know how much the robot has to rotate
+double angle2point(int x_coord_point) {
+  const double horizontalResolution = 3280;
+  const double widthFromMid = horizontalResolution / 2;
+  const double horizontalFOV = 62.2;
+  const double hFOVmiddle = horizontalFOV / 2;
+  double displacementRatio = double(x_coord_point) / widthFromMid;
+  double pointAngleHorizontal = (displacementRatio - 1) * hFOVmiddle;
+  return pointAngleHorizontal;
+}
+
+
+//////////////////// END PERSONAL FUNCTIONS //////////////////
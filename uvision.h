@@ -0,0 +1,51 @@
+#ifndef UVISION_H
+#define UVISION_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+ * Ball detection and the camera model used for ball and landmark bearings.
+ * The camera model is for the full resolution still image (3280 pixels wide,
+ * 62.2 degrees horizontal field of view). */
+
+/**
+ * Ball detector parameters, defaults are the hand-tuned values
+ * for the full resolution image. */
+class UHoughParam
+{
+public:
+  /// median blur aperture (odd)
+  int blur = 5;
+  /// contrast gain and offset after blur
+  double contrast = 2.1;
+  double brightness = 1;
+  /// minimum distance between circle centres is image rows / minDistDiv
+  int minDistDiv = 16;
+  /// Canny upper threshold and accumulator threshold
+  double param1 = 100;
+  double param2 = 20;
+  /// radius limits [pixels]
+  int minRadius = 40;
+  int maxRadius = 80;
+};
+
+/**
+ * Detect circles (balls) in an RGB image
+ * \returns list of circles as (x, y, radius) in pixels */
+std::vector<cv::Vec3f> houghcircles(cv::Mat img);
+/**
+ * Detect circles with these detector parameters */
+std::vector<cv::Vec3f> houghcircles(cv::Mat img, const UHoughParam & par);
+/**
+ * Find the closest (largest) circle
+ * \returns x pixel coordinate and radius of the closest circle */
+std::vector<double> closestBallcoord(std::vector<cv::Vec3f> circles);
+/**
+ * Distance to a ball with this radius (in pixels) */
+double PD2(double radius);
+/**
+ * Horizontal angle (degrees) to a point at this x pixel coordinate */
+double angle2point(int x_coord_point);
+
+#endif
@@ -0,0 +1,407 @@
+/**
+ * Offline micro-benchmark of the ball detection functions in uvision.cpp.
+ * Runs houghcircles(), closestBallcoord(), PD2(), angle2point() and the
+ * full detection over a directory of recorded frames at several widths,
+ * and reports throughput, latency percentiles, allocations and heap use.
+ * The result can be saved as a (JSON) baseline and later runs compared to it.
+ *
+ * build (glibc only, allocations are counted by wrapping malloc):
+ *   g++ -O2 -std=c++17 -pthread -o vision_bench vision_bench.cpp uvision.cpp utiming.cpp uperfcount.cpp umetrics.cpp utracer.cpp `pkg-config --cflags --libs opencv4`
+ * use:
+ *   vision_bench -d frames/ -o baseline.json
+ *   vision_bench -d frames/ -b baseline.json     (exit code 1 on regression)
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "uvision.h"
+
+using namespace std;
+using namespace cv;
+
+
+//////////////////// ALLOCATION COUNTING //////////////////
+
+extern "C"
+{
+  void * __libc_malloc(size_t size);
+  void * __libc_calloc(size_t n, size_t size);
+  void * __libc_realloc(void * p, size_t size);
+  void * __libc_memalign(size_t align, size_t size);
+  void __libc_free(void * p);
+}
+
+/// allocation statistics, updated from any thread (OpenCV uses worker threads)
+static atomic<bool> counting(false);
+static atomic<long> allocCnt(0);
+static atomic<long> allocBytes(0);
+static atomic<long> liveBytes(0);
+static atomic<long> peakBytes(0);
+
+static void countAlloc(void * p)
+{
+  if (p != NULL and counting.load(memory_order_relaxed))
+  {
+    long n = malloc_usable_size(p);
+    allocCnt.fetch_add(1, memory_order_relaxed);
+    allocBytes.fetch_add(n, memory_order_relaxed);
+    long live = liveBytes.fetch_add(n, memory_order_relaxed) + n;
+    long peak = peakBytes.load(memory_order_relaxed);
+    while (live > peak and not peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed))
+      ;
+  }
+}
+
+static void countFree(void * p)
+{
+  if (p != NULL and counting.load(memory_order_relaxed))
+    liveBytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+}
+
+extern "C" void * malloc(size_t size)
+{
+  void * p = __libc_malloc(size);
+  countAlloc(p);
+  return p;
+}
+
+extern "C" void * calloc(size_t n, size_t size)
+{
+  void * p = __libc_calloc(n, size);
+  countAlloc(p);
+  return p;
+}
+
+extern "C" void * realloc(void * p, size_t size)
+{
+  countFree(p);
+  void * q = __libc_realloc(p, size);
+  countAlloc(q);
+  return q;
+}
+
+extern "C" int posix_memalign(void ** p, size_t align, size_t size)
+{
+  *p = __libc_memalign(align, size);
+  countAlloc(*p);
+  return *p == NULL ? ENOMEM : 0;
+}
+
+extern "C" void * aligned_alloc(size_t align, size_t size)
+{
+  void * p = __libc_memalign(align, size);
+  countAlloc(p);
+  return p;
+}
+
+extern "C" void free(void * p)
+{
+  countFree(p);
+  __libc_free(p);
+}
+
+
+//////////////////// MEASUREMENT //////////////////
+
+/**
+ * Latency samples and allocations for one function at one width */
+class UBenchResult
+{
+public:
+  string function;
+  int width;
+  /// latency per call [us]
+  vector<double> samples;
+  long allocs = 0;
+  long bytes = 0;
+  long peak = 0;
+  double totalSec = 0;
+  double p50, p95, p99, mean;
+  double callsPerSec;
+
+  void finish()
+  {
+    sort(samples.begin(), samples.end());
+    int n = samples.size();
+    p50 = p95 = p99 = mean = callsPerSec = 0;
+    if (n == 0)
+      return;
+    p50 = samples[n * 50 / 100];
+    p95 = samples[min(n - 1, n * 95 / 100)];
+    p99 = samples[min(n - 1, n * 99 / 100)];
+    double sum = 0;
+    for (double s : samples)
+      sum += s;
+    mean = sum / n;
+    callsPerSec = n / max(totalSec, 1e-9);
+  }
+  double allocsPerCall() { return samples.empty() ? 0 : double(allocs) / samples.size(); }
+  double bytesPerCall() { return samples.empty() ? 0 : double(bytes) / samples.size(); }
+};
+
+/**
+ * Measure one call of 'f', 'reps' times in a row (for very short functions)
+ * and add the average to 'r' */
+template <typename F>
+static void measure(UBenchResult & r, int reps, F f)
+{
+  long a0 = allocCnt;
+  long b0 = allocBytes;
+  peakBytes = liveBytes.load();
+  long live0 = liveBytes;
+  counting = true;
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  for (int i = 0; i < reps; i++)
+    f();
+  chrono::duration<double> dt = chrono::steady_clock::now() - t0;
+  counting = false;
+  r.samples.push_back(dt.count() * 1e6 / reps);
+  r.totalSec += dt.count();
+  r.allocs += (allocCnt - a0) / reps;
+  r.bytes += (allocBytes - b0) / reps;
+  r.peak = max(r.peak, peakBytes - live0);
+}
+
+
+//////////////////// BASELINE FILES //////////////////
+
+static bool writeBaseline(const char * name, vector<UBenchResult> & results)
+{
+  FILE * f = fopen(name, "w");
+  if (f == NULL)
+  {
+    printf("# failed to write baseline '%s'\n", name);
+    return false;
+  }
+  long maxRss = 0;
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    maxRss = ru.ru_maxrss;
+  fprintf(f, "{\n  \"peak_rss_kb\": %ld,\n  \"results\": [\n", maxRss);
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    UBenchResult & r = results[i];
+    fprintf(f, "    {\"function\": \"%s\", \"width\": %d, \"calls\": %d, "
+               "\"calls_per_sec\": %.1f, \"mean_us\": %.2f, \"p50_us\": %.2f, "
+               "\"p95_us\": %.2f, \"p99_us\": %.2f, \"allocs_per_call\": %.1f, "
+               "\"bytes_per_call\": %.0f, \"peak_heap_bytes\": %ld}%s\n",
+            r.function.c_str(), r.width, int(r.samples.size()),
+            r.callsPerSec, r.mean, r.p50, r.p95, r.p99,
+            r.allocsPerCall(), r.bytesPerCall(), r.peak,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return true;
+}
+
+/**
+ * Find a number after "key": in a line
+ * \returns false if not found */
+static bool jsonValue(const char * line, const char * key, double & value)
+{
+  const int MSL = 50;
+  char s[MSL];
+  snprintf(s, MSL, "\"%s\":", key);
+  const char * p = strstr(line, s);
+  if (p == NULL)
+    return false;
+  value = strtod(p + strlen(s), NULL);
+  return true;
+}
+
+/**
+ * Compare with a baseline written by this tool (one result per line)
+ * \returns number of regressions */
+static int compareBaseline(const char * name, vector<UBenchResult> & results, double tolerance)
+{
+  FILE * f = fopen(name, "r");
+  if (f == NULL)
+  {
+    printf("# failed to read baseline '%s'\n", name);
+    return 0;
+  }
+  int regressions = 0;
+  const int MSL = 1000;
+  char s[MSL];
+  printf("# compare to %s (tolerance %.0f%%)\n", name, tolerance * 100);
+  while (fgets(s, MSL, f) != NULL)
+  {
+    const char * p = strstr(s, "\"function\": \"");
+    double width, p50, p95, allocs;
+    if (p == NULL or not jsonValue(s, "width", width) or not jsonValue(s, "p50_us", p50) or
+        not jsonValue(s, "p95_us", p95) or not jsonValue(s, "allocs_per_call", allocs))
+      continue;
+    p += strlen("\"function\": \"");
+    string function(p, strcspn(p, "\""));
+    for (UBenchResult & r : results)
+    {
+      if (r.function != function or r.width != int(width))
+        continue;
+      bool slower = r.p50 > p50 * (1 + tolerance) or r.p95 > p95 * (1 + tolerance);
+      bool moreAllocs = r.allocsPerCall() > allocs + 0.5;
+      if (slower or moreAllocs)
+      {
+        regressions++;
+        printf("# REGRESSION %-16s %5d: p50 %.1f -> %.1f us, p95 %.1f -> %.1f us, allocs %.1f -> %.1f\n",
+               function.c_str(), r.width, p50, r.p50, p95, r.p95, allocs, r.allocsPerCall());
+      }
+    }
+  }
+  fclose(f);
+  printf("# %d regressions\n", regressions);
+  return regressions;
+}
+
+
+//////////////////// MAIN //////////////////
+
+static void printHelp(const char * name)
+{
+  printf("Usage: %s -d <frame dir> [options]\n", name);
+  printf("  -d dir      directory with recorded frames (*.jpg, *.png)\n");
+  printf("  -w list     frame widths, comma separated, 0 is original (default 0,1640,820,410)\n");
+  printf("  -n count    passes over the frames (default 3)\n");
+  printf("  -o file     write baseline (JSON)\n");
+  printf("  -b file     compare with baseline, exit code 1 on regression\n");
+  printf("  -t percent  allowed slowdown before regression (default 10)\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+  const char * dir = NULL;
+  const char * outName = NULL;
+  const char * baseName = NULL;
+  vector<int> widths = {0, 1640, 820, 410};
+  int passes = 3;
+  double tolerance = 0.10;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:w:n:o:b:t:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd': dir = optarg; break;
+      case 'w':
+        widths.clear();
+        for (char * p = strtok(optarg, ","); p != NULL; p = strtok(NULL, ","))
+          widths.push_back(atoi(p));
+        break;
+      case 'n': passes = max(1, atoi(optarg)); break;
+      case 'o': outName = optarg; break;
+      case 'b': baseName = optarg; break;
+      case 't': tolerance = atof(optarg) / 100; break;
+      default:
+        printHelp(argv[0]);
+        return 0;
+    }
+  }
+  if (dir == NULL)
+  {
+    printHelp(argv[0]);
+    return 1;
+  }
+  vector<String> names, png;
+  glob(string(dir) + "/*.jpg", names, false);
+  glob(string(dir) + "/*.png", png, false);
+  names.insert(names.end(), png.begin(), png.end());
+  vector<Mat> frames;
+  for (const String & name : names)
+  {
+    Mat img = imread(name);
+    if (not img.empty())
+      frames.push_back(img);
+  }
+  if (frames.empty())
+  {
+    printf("# no frames found in '%s'\n", dir);
+    return 1;
+  }
+  printf("# %d frames from %s, %d passes\n", int(frames.size()), dir, passes);
+  vector<UBenchResult> results;
+  for (int w : widths)
+  { // scale frames outside the measurement
+    vector<Mat> scaled;
+    for (Mat & img : frames)
+    {
+      if (w <= 0 or w == img.cols)
+        scaled.push_back(img);
+      else
+      {
+        Mat s;
+        resize(img, s, Size(w, cvRound(img.rows * double(w) / img.cols)), 0, 0, INTER_AREA);
+        scaled.push_back(s);
+      }
+    }
+    int width = scaled.front().cols;
+    UBenchResult hough, closest, pd2, angle, detect;
+    hough.function = "houghcircles";
+    closest.function = "closestBallcoord";
+    pd2.function = "PD2";
+    angle.function = "angle2point";
+    detect.function = "detection";
+    hough.width = closest.width = pd2.width = angle.width = detect.width = width;
+    int found = 0;
+    for (int pass = 0; pass < passes; pass++)
+    {
+      for (Mat & img : scaled)
+      {
+        vector<Vec3f> circles;
+        measure(hough, 1, [&]() { circles = houghcircles(img); });
+        // closestBallcoord needs at least one circle
+        if (circles.empty())
+          continue;
+        found++;
+        vector<double> params;
+        measure(closest, 1, [&]() { params = closestBallcoord(circles); });
+        volatile double sink;
+        measure(pd2, 1000, [&]() { sink = PD2(params[1]); });
+        measure(angle, 1000, [&]() { sink = angle2point(params[0]); });
+        (void)sink;
+        // end-to-end, as used in the mission
+        measure(detect, 1, [&]() {
+          vector<Vec3f> c = houghcircles(img);
+          if (not c.empty())
+          {
+            vector<double> p = closestBallcoord(c);
+            sink = angle2point(p[0]) + PD2(p[1]);
+          }
+        });
+      }
+    }
+    printf("# width %d: ball found in %d of %d frames\n", width, found, int(scaled.size()) * passes);
+    for (UBenchResult * r : {&hough, &closest, &pd2, &angle, &detect})
+    {
+      r->finish();
+      results.push_back(*r);
+    }
+  }
+  printf("%-18s %5s %6s %10s %10s %10s %10s %9s %11s %11s\n",
+         "function", "width", "calls", "calls/s", "p50 us", "p95 us", "p99 us",
+         "allocs", "bytes/call", "peak heap");
+  for (UBenchResult & r : results)
+    printf("%-18s %5d %6d %10.1f %10.2f %10.2f %10.2f %9.1f %11.0f %11ld\n",
+           r.function.c_str(), r.width, int(r.samples.size()), r.callsPerSec,
+           r.p50, r.p95, r.p99, r.allocsPerCall(), r.bytesPerCall(), r.peak);
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    printf("# peak RSS %ld kB\n", ru.ru_maxrss);
+  if (outName != NULL)
+    writeBaseline(outName, results);
+  int regressions = 0;
+  if (baseName != NULL)
+    regressions = compareBaseline(baseName, results, tolerance);
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,448 @@
+/**
+ * Synthetic ball scenes and ball detector parameter sweep.
+ * Renders scenes with a ball at known distance and bearing (using the inverse
+ * of the camera model in uvision.cpp), with random lighting, blur, noise and
+ * distractors (tape lines, cage bars). Then runs houghcircles() with every
+ * combination of the swept parameters and image widths on all cores, and
+ * prints the detection rate versus latency Pareto front, and the cheapest
+ * setting that meets the required detection rate.
+ *
+ * build:
+ *   g++ -O2 -std=c++17 -pthread -o vision_sweep vision_sweep.cpp uvision.cpp utiming.cpp uperfcount.cpp umetrics.cpp utracer.cpp `pkg-config --cflags --libs opencv4`
+ * use:
+ *   vision_sweep -n 40 -r 95 -o sweep.csv
+ *   vision_sweep -w 3280,1640 -S scenes/      (also save the scenes as png)
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "uvision.h"
+
+using namespace std;
+using namespace cv;
+
+/// full resolution of the camera model
+static const int fullWidth = 3280;
+static const int fullHeight = 2464;
+
+
+//////////////////// SCENES //////////////////
+
+/**
+ * A rendered scene and its ground truth */
+class UScene
+{
+public:
+  Mat img;
+  /// ball distance (PD2 units) and bearing [degrees]
+  double distance;
+  double bearing;
+  /// ball in full resolution pixels
+  double x, y, radius;
+  /// variations used
+  double light, blur, noise;
+};
+
+/**
+ * Ball radius in full resolution pixels at this distance - inverse of PD2() */
+static double radiusAt(double distance)
+{ // PD2 is inverse proportional to the radius
+  return PD2(1.0) / distance;
+}
+
+/**
+ * Full resolution x pixel coordinate at this bearing - inverse of angle2point() */
+static double xAt(double bearing)
+{
+  double a0 = angle2point(0);
+  double a1 = angle2point(fullWidth);
+  return (bearing - a0) / (a1 - a0) * fullWidth;
+}
+
+/**
+ * Render a scene with one ball, the image is 'width' pixels wide */
+static void renderScene(UScene & sc, int width, mt19937 & rng)
+{
+  uniform_real_distribution<double> u(0, 1);
+  double s = double(width) / fullWidth;
+  int height = cvRound(fullHeight * s);
+  // floor and wall, with a lighting gradient
+  Mat img(height, width, CV_8UC3);
+  Scalar floor(90 + 60 * u(rng), 90 + 60 * u(rng), 90 + 60 * u(rng));
+  Scalar wall(170 + 60 * u(rng), 170 + 60 * u(rng), 170 + 60 * u(rng));
+  int horizon = cvRound(height * (0.25 + 0.15 * u(rng)));
+  img.rowRange(0, horizon).setTo(wall);
+  img.rowRange(horizon, height).setTo(floor);
+  // distractors: tape lines on the floor and cage bars
+  int lines = int(u(rng) * 4);
+  for (int i = 0; i < lines; i++)
+  {
+    Point p1(cvRound(u(rng) * width), horizon);
+    Point p2(cvRound(u(rng) * width), height);
+    line(img, p1, p2, Scalar(20, 20, 20), max(1, cvRound(60 * s)), LINE_AA);
+  }
+  int bars = int(u(rng) * 6);
+  for (int i = 0; i < bars; i++)
+  {
+    int x = cvRound(u(rng) * width);
+    line(img, Point(x, 0), Point(x, height), Scalar(60, 60, 60), max(1, cvRound(25 * s)), LINE_AA);
+  }
+  // the ball, on the floor, fully inside the image
+  sc.radius = radiusAt(sc.distance);
+  sc.x = min(max(xAt(sc.bearing), sc.radius), fullWidth - sc.radius);
+  sc.bearing = angle2point(cvRound(sc.x));
+  double yMin = max(horizon / s + sc.radius, fullHeight * 0.45);
+  sc.y = yMin + (fullHeight - sc.radius - yMin) * u(rng);
+  Point c(cvRound(sc.x * s), cvRound(sc.y * s));
+  double r = sc.radius * s;
+  // shadow, then shaded ball with a highlight up left
+  ellipse(img, c + Point(0, cvRound(r * 0.9)), Size(cvRound(r), cvRound(r * 0.25)), 0, 0, 360,
+          Scalar(40, 40, 40), FILLED, LINE_AA);
+  Scalar ball = u(rng) < 0.5 ? Scalar(20, 90, 230) : Scalar(200, 80, 30);
+  const int shades = 8;
+  for (int i = 0; i < shades; i++)
+  {
+    double f = 1 - double(i) / shades;
+    Point ci = c + Point(cvRound(-r * 0.3 * (1 - f)), cvRound(-r * 0.3 * (1 - f)));
+    double gain = 0.6 + 0.6 * (1 - f);
+    circle(img, ci, max(1, cvRound(r * f)), ball * gain, FILLED, LINE_AA);
+  }
+  // lighting level and gradient across the image
+  sc.light = 0.5 + 0.8 * u(rng);
+  Mat gradient(1, width, CV_32F);
+  double slope = (u(rng) - 0.5) * 0.6;
+  for (int i = 0; i < width; i++)
+    gradient.at<float>(i) = sc.light * (1 + slope * (double(i) / width - 0.5));
+  Mat f;
+  img.convertTo(f, CV_32FC3);
+  Mat g;
+  cvtColor(repeat(gradient, height, 1), g, COLOR_GRAY2BGR);
+  multiply(f, g, f);
+  // motion or focus blur (sigma in full resolution pixels)
+  sc.blur = u(rng) * 8;
+  if (sc.blur * s > 0.3)
+    GaussianBlur(f, f, Size(0, 0), sc.blur * s);
+  // sensor noise
+  sc.noise = u(rng) * 12;
+  Mat n(f.size(), f.type());
+  randn(n, Scalar::all(0), Scalar::all(sc.noise));
+  f += n;
+  f.convertTo(sc.img, CV_8UC3);
+}
+
+
+//////////////////// SWEEP //////////////////
+
+/**
+ * One detector setting and its result over all scenes */
+class USetting
+{
+public:
+  int width;
+  UHoughParam par;
+  /// fraction of scenes with the ball found within tolerance
+  double rate = 0;
+  /// circles found that were not the ball, per scene
+  double falsePerScene = 0;
+  /// distance and bearing errors for the found balls
+  double distErr = 0;
+  double bearingErr = 0;
+  /// latency per call [ms]
+  double meanMs = 0;
+  double p95Ms = 0;
+};
+
+/**
+ * Run the detector on all scenes, as in the mission:
+ * the closest (largest) circle is the ball */
+static void evaluate(USetting & st, const vector<UScene> & scenes,
+                     double maxDistErr, double maxBearingErr)
+{
+  double s = double(st.width) / fullWidth;
+  vector<double> ms;
+  int found = 0;
+  int falseCnt = 0;
+  double dErr = 0, bErr = 0;
+  for (const UScene & sc : scenes)
+  {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    vector<Vec3f> circles = houghcircles(sc.img, st.par);
+    chrono::duration<double, milli> dt = chrono::steady_clock::now() - t0;
+    ms.push_back(dt.count());
+    if (circles.empty())
+      continue;
+    vector<double> params = closestBallcoord(circles);
+    // back to full resolution, as the camera model
+    double distance = PD2(params[1] / s);
+    double bearing = angle2point(cvRound(params[0] / s));
+    double de = fabs(distance - sc.distance) / sc.distance;
+    double be = fabs(bearing - sc.bearing);
+    if (de <= maxDistErr and be <= maxBearingErr)
+    {
+      found++;
+      dErr += de;
+      bErr += be;
+      falseCnt += circles.size() - 1;
+    }
+    else
+      falseCnt += circles.size();
+  }
+  sort(ms.begin(), ms.end());
+  double sum = 0;
+  for (double t : ms)
+    sum += t;
+  st.meanMs = sum / max<size_t>(1, ms.size());
+  st.p95Ms = ms.empty() ? 0 : ms[min(ms.size() - 1, ms.size() * 95 / 100)];
+  st.rate = double(found) / max<size_t>(1, scenes.size());
+  st.falsePerScene = double(falseCnt) / max<size_t>(1, scenes.size());
+  st.distErr = found > 0 ? dErr / found : 0;
+  st.bearingErr = found > 0 ? bErr / found : 0;
+}
+
+/**
+ * Settings not beaten by a faster one with the same or better detection rate,
+ * sorted by latency */
+static vector<USetting *> paretoFront(vector<USetting> & all)
+{
+  vector<USetting *> sorted;
+  for (USetting & st : all)
+    sorted.push_back(&st);
+  sort(sorted.begin(), sorted.end(), [](USetting * a, USetting * b) {
+    if (a->meanMs != b->meanMs)
+      return a->meanMs < b->meanMs;
+    return a->rate > b->rate;
+  });
+  vector<USetting *> front;
+  double best = -1;
+  for (USetting * st : sorted)
+  {
+    if (st->rate > best)
+    {
+      front.push_back(st);
+      best = st->rate;
+    }
+  }
+  return front;
+}
+
+static void printSetting(FILE * f, USetting & st, bool csv)
+{
+  const UHoughParam & p = st.par;
+  if (csv)
+    fprintf(f, "%d,%d,%.2f,%.0f,%.0f,%d,%d,%.4f,%.3f,%.4f,%.3f,%.3f,%.3f\n",
+            st.width, p.blur, p.contrast, p.param1, p.param2, p.minRadius, p.maxRadius,
+            st.rate, st.falsePerScene, st.distErr, st.bearingErr, st.meanMs, st.p95Ms);
+  else
+    fprintf(f, "%5d %4d %5.2f %5.0f %5.0f %4d-%-4d %6.1f%% %6.2f %6.1f%% %6.2f %8.2f %8.2f\n",
+            st.width, p.blur, p.contrast, p.param1, p.param2, p.minRadius, p.maxRadius,
+            st.rate * 100, st.falsePerScene, st.distErr * 100, st.bearingErr, st.meanMs, st.p95Ms);
+}
+
+static void printHeader()
+{
+  printf("%5s %4s %5s %5s %5s %9s %7s %6s %7s %6s %8s %8s\n",
+         "width", "blur", "contr", "p1", "p2", "radius", "rate", "false", "dist", "deg",
+         "mean ms", "p95 ms");
+}
+
+
+//////////////////// MAIN //////////////////
+
+/**
+ * Parse a comma separated list of numbers */
+static vector<double> numberList(char * s)
+{
+  vector<double> v;
+  for (char * p = strtok(s, ","); p != NULL; p = strtok(NULL, ","))
+    v.push_back(strtod(p, NULL));
+  return v;
+}
+
+static void printHelp(const char * name)
+{
+  printf("Usage: %s [options]\n", name);
+  printf("  -n count    scenes per width (default 40)\n");
+  printf("  -s seed     random seed for the scenes (default 1)\n");
+  printf("  -d min,max  ball distance range, PD2 units (default 200,600)\n");
+  printf("  -w list     image widths (default 1640,820,410)\n");
+  printf("  -B list     median blur apertures (default 3,5,7)\n");
+  printf("  -c list     contrast gains (default 1.5,2.1,3)\n");
+  printf("  -1 list     Canny thresholds, param1 (default 60,100,150)\n");
+  printf("  -2 list     accumulator thresholds, param2 (default 15,20,30)\n");
+  printf("  -R list     radius range scale around 40-80 pixels (default 1,1.5)\n");
+  printf("  -e dist,deg max distance error %% and bearing error for a hit (default 15,2)\n");
+  printf("  -r percent  required detection rate (default 90)\n");
+  printf("  -j threads  worker threads (default all cores)\n");
+  printf("  -o file     write all results (CSV)\n");
+  printf("  -S dir      save the scenes as png\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+  int sceneCnt = 40;
+  unsigned seed = 1;
+  double minDist = 200, maxDist = 600;
+  vector<double> widths = {1640, 820, 410};
+  vector<double> blurs = {3, 5, 7};
+  vector<double> contrasts = {1.5, 2.1, 3};
+  vector<double> param1s = {60, 100, 150};
+  vector<double> param2s = {15, 20, 30};
+  vector<double> radiusScales = {1, 1.5};
+  double maxDistErr = 0.15, maxBearingErr = 2;
+  double required = 0.9;
+  int threads = max(1u, thread::hardware_concurrency());
+  const char * csvName = NULL;
+  const char * sceneDir = NULL;
+  vector<double> v;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:d:w:B:c:1:2:R:e:r:j:o:S:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': sceneCnt = max(1, atoi(optarg)); break;
+      case 's': seed = atoi(optarg); break;
+      case 'd':
+        v = numberList(optarg);
+        if (v.size() == 2)
+        {
+          minDist = v[0];
+          maxDist = v[1];
+        }
+        break;
+      case 'w': widths = numberList(optarg); break;
+      case 'B': blurs = numberList(optarg); break;
+      case 'c': contrasts = numberList(optarg); break;
+      case '1': param1s = numberList(optarg); break;
+      case '2': param2s = numberList(optarg); break;
+      case 'R': radiusScales = numberList(optarg); break;
+      case 'e':
+        v = numberList(optarg);
+        if (v.size() == 2)
+        {
+          maxDistErr = v[0] / 100;
+          maxBearingErr = v[1];
+        }
+        break;
+      case 'r': required = atof(optarg) / 100; break;
+      case 'j': threads = max(1, atoi(optarg)); break;
+      case 'o': csvName = optarg; break;
+      case 'S': sceneDir = optarg; break;
+      default:
+        printHelp(argv[0]);
+        return 0;
+    }
+  }
+  // parallel over settings, not inside OpenCV, for clean latencies
+  setNumThreads(1);
+  UHoughParam def;
+  vector<USetting> all;
+  for (double w : widths)
+  {
+    // same scenes (same seed) for every width
+    mt19937 rng(seed);
+    uniform_real_distribution<double> u(0, 1);
+    vector<UScene> scenes(sceneCnt);
+    for (int i = 0; i < sceneCnt; i++)
+    {
+      scenes[i].distance = minDist + (maxDist - minDist) * u(rng);
+      scenes[i].bearing = (u(rng) - 0.5) * 50;
+      renderScene(scenes[i], int(w), rng);
+      if (sceneDir != NULL)
+      {
+        const int MSL = 300;
+        char s[MSL];
+        snprintf(s, MSL, "%s/scene_%d_%03d_d%.0f_b%.1f.png", sceneDir, int(w), i,
+                 scenes[i].distance, scenes[i].bearing);
+        imwrite(s, scenes[i].img);
+      }
+    }
+    // all settings for this width
+    double s = w / fullWidth;
+    size_t first = all.size();
+    for (double blur : blurs)
+      for (double contrast : contrasts)
+        for (double p1 : param1s)
+          for (double p2 : param2s)
+            for (double rs : radiusScales)
+            {
+              USetting st;
+              st.width = int(w);
+              st.par.blur = int(blur) | 1;
+              st.par.contrast = contrast;
+              st.par.param1 = p1;
+              st.par.param2 = p2;
+              // radius range widened around the tuned 40-80, in scaled pixels
+              double mid = (def.minRadius + def.maxRadius) / 2.0;
+              double half = (def.maxRadius - def.minRadius) / 2.0 * rs;
+              st.par.minRadius = max(1, cvRound((mid - half) * s));
+              st.par.maxRadius = max(st.par.minRadius + 1, cvRound((mid + half) * s));
+              all.push_back(st);
+            }
+    printf("# width %d: %d scenes, %d settings on %d threads\n",
+           int(w), sceneCnt, int(all.size() - first), threads);
+    atomic<size_t> next(first);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+      workers.push_back(thread([&]() {
+        for (size_t i = next++; i < all.size(); i = next++)
+          evaluate(all[i], scenes, maxDistErr, maxBearingErr);
+      }));
+    for (thread & t : workers)
+      t.join();
+  }
+  if (csvName != NULL)
+  {
+    FILE * f = fopen(csvName, "w");
+    if (f != NULL)
+    {
+      fprintf(f, "width,blur,contrast,param1,param2,min_radius,max_radius,"
+                 "rate,false_per_scene,dist_err,bearing_err,mean_ms,p95_ms\n");
+      for (USetting & st : all)
+        printSetting(f, st, true);
+      fclose(f);
+    }
+    else
+      printf("# failed to write '%s'\n", csvName);
+  }
+  vector<USetting *> front = paretoFront(all);
+  printf("# Pareto front, detection rate versus latency (%d settings)\n", int(all.size()));
+  printHeader();
+  for (USetting * st : front)
+    printSetting(stdout, *st, false);
+  // the tuned setting, at full resolution scale, if swept
+  for (USetting & st : all)
+  {
+    if (st.width == fullWidth / 2 and st.par.blur == def.blur and st.par.contrast == def.contrast and
+        st.par.param1 == def.param1 and st.par.param2 == def.param2 and
+        st.par.minRadius == def.minRadius / 2 and st.par.maxRadius == def.maxRadius / 2)
+    {
+      printf("# current values (at width %d)\n", st.width);
+      printSetting(stdout, st, false);
+      break;
+    }
+  }
+  for (USetting * st : front)
+  {
+    if (st->rate >= required)
+    {
+      printf("# cheapest setting with detection rate >= %.0f%%\n", required * 100);
+      printSetting(stdout, *st, false);
+      return 0;
+    }
+  }
+  printf("# no setting reached detection rate %.0f%%\n", required * 100);
+  return 1;
+}